@@ -0,0 +1,241 @@
+#include "DxfBatchReader.h"
+#include "DxfCompression.h"
+#include "DxfReader.h"
+
+#include "Core/ProcessUtils.h"
+#include "Core/Timer.h"
+#include "Core/WorkQueue.h"
+#include "IO/FileSystem.h"
+#include "IO/Log.h"
+#include "IO/MappedFile.h"
+
+DxfBatchReader::DxfBatchReader(Context* context) :
+	Object(context),
+	callback_(0),
+	userData_(0),
+	maxInFlightBytes_(256 * 1024 * 1024),
+	numParsed_(0),
+	numFailed_(0),
+	bytesRead_(0),
+	peakInFlightBytes_(0)
+{
+	if (!GetSubsystem<FileSystem>())
+		GetContext()->RegisterSubsystem(new FileSystem(GetContext()));
+}
+
+void DxfBatchReader::AddFile(const String& path)
+{
+	paths_.Push(path);
+}
+
+void DxfBatchReader::AddDirectory(const String& path, const String& filter, bool recursive)
+{
+	Vector<String> names;
+	GetSubsystem<FileSystem>()->ScanDir(names, path, filter, SCAN_FILES, recursive);
+
+	String directory = AddTrailingSlash(path);
+	for (unsigned i = 0; i < names.Size(); ++i)
+		paths_.Push(directory + names[i]);
+}
+
+void DxfBatchReader::ExpandWork(const WorkItem* item, unsigned threadIndex)
+{
+	DxfBatchReader* batch = static_cast<DxfBatchReader*>(item->start_);
+	Job* job = static_cast<Job*>(item->aux_);
+
+	//on this worker only: the shared queue would wait for the other files too
+	MappedFile mapping(job->result_.path_);
+	job->parsed_ = mapping.IsOpen() &&
+		DecompressDxf(mapping.GetData(), mapping.GetSize(), job->expanded_, job->expandedSize_);
+
+	MutexLock lock(batch->finishedMutex_);
+	batch->finished_.Push(job);
+}
+
+void DxfBatchReader::ParseWork(const WorkItem* item, unsigned threadIndex)
+{
+	DxfBatchReader* batch = static_cast<DxfBatchReader*>(item->start_);
+	Job* job = static_cast<Job*>(item->aux_);
+
+	job->parsed_ = job->reader_->Parse();
+
+	MutexLock lock(batch->finishedMutex_);
+	batch->finished_.Push(job);
+}
+
+void DxfBatchReader::TakeFinished(PODVector<Job*>& finished)
+{
+	MutexLock lock(finishedMutex_);
+	finished = finished_;
+	finished_.Clear();
+}
+
+bool DxfBatchReader::Measure(Job& job, const String& path)
+{
+	job.result_.path_ = path;
+	job.result_.size_ = 0;
+	job.memory_ = 0;
+	job.compressed_ = false;
+	job.expandedSize_ = 0;
+	job.parsed_ = false;
+
+	//the reader asserts that its file opens
+	if (!GetSubsystem<FileSystem>()->FileExists(path))
+		return false;
+
+	//only the pages of the block headers are read
+	MappedFile mapping(path);
+	if (!mapping.IsOpen())
+		return false;
+
+	job.result_.size_ = mapping.GetSize();
+	job.memory_ = job.result_.size_;
+
+	if (IsDxfCompressed(mapping.GetData(), mapping.GetSize()))
+	{
+		DxfOffset unpackedSize;
+		if (!GetDxfUnpackedSize(mapping.GetData(), mapping.GetSize(), unpackedSize))
+			return false;
+
+		job.compressed_ = true;
+		job.memory_ += unpackedSize;
+	}
+
+	return true;
+}
+
+void DxfBatchReader::Submit(WorkQueue* queue, Job& job, void (*work)(const WorkItem*, unsigned))
+{
+	SharedPtr<WorkItem> item = queue->GetFreeItem();
+	item->priority_ = M_MAX_UNSIGNED;
+	item->workFunction_ = work;
+	item->start_ = this;
+	item->aux_ = &job;
+	queue->AddWorkItem(item);
+}
+
+void DxfBatchReader::Finish(Job& job)
+{
+	if (job.parsed_)
+	{
+		job.result_.document_ = job.reader_->GetDocument();
+		bytesRead_ += job.result_.size_;
+		++numParsed_;
+	}
+	else
+	{
+		URHO3D_LOGERROR("DXF: could not read " + job.result_.path_);
+		++numFailed_;
+	}
+
+	//unmap the file, or free the expanded one, before the callback gets the document
+	job.reader_.Reset();
+	job.expanded_.Reset();
+
+	if (callback_)
+		callback_(job.result_, userData_);
+
+	job.result_.document_.Reset();
+}
+
+unsigned DxfBatchReader::Run()
+{
+	numParsed_ = 0;
+	numFailed_ = 0;
+	bytesRead_ = 0;
+	peakInFlightBytes_ = 0;
+	finished_.Clear();
+
+	if (paths_.Empty())
+		return 0;
+
+	//the readers would make the log on the workers otherwise
+	if (!GetSubsystem<Log>())
+		GetContext()->RegisterSubsystem(new Log(GetContext()));
+
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	if (!queue)
+	{
+		//the calling thread only starts and finishes files, but it is not idle either, so leave it a core
+		queue = new WorkQueue(GetContext());
+		GetContext()->RegisterSubsystem(queue);
+		queue->CreateThreads(Max((int)GetNumLogicalCPUs() - 1, 1));
+	}
+
+	//jobs don't move, the workers hold pointers to them
+	Vector<Job> jobs(paths_.Size());
+	PODVector<Job*> finished;
+	unsigned next = 0;
+	bool measured = false;
+	unsigned numInFlight = 0;
+	DxfOffset inFlightBytes = 0;
+
+	while (next < jobs.Size() || numInFlight)
+	{
+		//start files while they fit
+		while (next < jobs.Size())
+		{
+			Job& job = jobs[next];
+
+			if (!measured && !Measure(job, paths_[next]))
+			{
+				++next;
+				Finish(job);
+				continue;
+			}
+
+			measured = true;
+			if (numInFlight && inFlightBytes + job.memory_ > maxInFlightBytes_)
+				break;
+
+			measured = false;
+			++next;
+
+			++numInFlight;
+			inFlightBytes += job.memory_;
+			peakInFlightBytes_ = Max(peakInFlightBytes_, inFlightBytes);
+
+			if (job.compressed_)
+				Submit(queue, job, ExpandWork);
+			else
+			{
+				job.reader_ = new DxfReader(GetContext(), job.result_.path_);
+				job.reader_->SetLogLevel(LOG_NONE);
+				Submit(queue, job, ParseWork);
+			}
+		}
+
+		if (!queue->GetNumThreads())
+			queue->Complete(M_MAX_UNSIGNED);
+
+		TakeFinished(finished);
+		if (finished.Empty())
+		{
+			Time::Sleep(1);
+			continue;
+		}
+
+		for (unsigned i = 0; i < finished.Size(); ++i)
+		{
+			Job& job = *finished[i];
+
+			//expanded: back to the workers to be parsed
+			if (job.compressed_ && !job.reader_ && job.parsed_)
+			{
+				job.reader_ = new DxfReader(GetContext(), job.expanded_.Get(), job.expandedSize_);
+				job.reader_->SetLogLevel(LOG_NONE);
+				Submit(queue, job, ParseWork);
+				continue;
+			}
+
+			--numInFlight;
+			inFlightBytes -= job.memory_;
+			Finish(job);
+		}
+	}
+
+	//nothing is left running; this only returns the items to the pool
+	queue->Complete(M_MAX_UNSIGNED);
+
+	return numParsed_;
+}
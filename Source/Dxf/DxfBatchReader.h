@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Core/Mutex.h"
+#include "Core/Object.h"
+#include "Container/ArrayPtr.h"
+#include "Container/Ptr.h"
+#include "Container/Str.h"
+#include "Container/Vector.h"
+#include "DxfDocument.h"
+#include "DxfTokenizer.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class WorkQueue;
+	struct WorkItem;
+}
+
+class DxfReader;
+
+//one file of a batch, as it is handed to the callback
+struct DxfBatchResult
+{
+	String path_;
+	//null if the file could not be opened or parsed
+	SharedPtr<DxfDocument> document_;
+	//bytes of the file
+	DxfOffset size_;
+};
+
+//called on the thread that runs the batch, once per file, in the order the files finish
+typedef void (*DxfBatchCallback)(const DxfBatchResult& result, void* userData);
+
+/**************************************************************************
+Batch ingestion. Many files are parsed at once on the WorkQueue, one file
+per work item:
+ ---- AddFile(path), AddDirectory(path)   <- what to read
+ ---- SetCallback(callback, userData)     <- where each document goes
+ ---- Run()                               <- parse them all, returns how many were parsed
+
+Files are started in the order they were added, and as many run at once as
+the queue has threads. A file is in flight from the time its reader maps it
+until its document has gone to the callback; while the bytes of the files
+in flight would go past SetMaxInFlightBytes(), no new file is started, so a
+directory of large files does not hold them all at once. One file is always
+let through, however large. A .dxf.lz4 file counts with the size it expands
+to, read from its block headers, as well as its own.
+
+Readers are made and destroyed on the calling thread, which should be the
+main one; only Parse() runs on the workers, with the log off. A compressed
+file goes to the workers twice: first to be expanded, on that worker alone,
+then to be parsed from the expanded buffer. The callback runs on the
+calling thread too, so it can use the context freely. Keep the documents it
+is given, or they are freed when it returns.
+***************************************************************************/
+class DxfBatchReader : public Object
+{
+	URHO3D_OBJECT(DxfBatchReader, Object);
+
+public:
+	DxfBatchReader(Context* context);
+
+	void AddFile(const String& path);
+	//the files of a directory that match filter, eg "*.dxf"
+	void AddDirectory(const String& path, const String& filter = "*.dxf", bool recursive = false);
+	void ClearFiles() { paths_.Clear(); }
+	const Vector<String>& GetFiles() const { return paths_; }
+
+	void SetCallback(DxfBatchCallback callback, void* userData) { callback_ = callback; userData_ = userData; }
+	void SetMaxInFlightBytes(DxfOffset bytes) { maxInFlightBytes_ = bytes; }
+	DxfOffset GetMaxInFlightBytes() const { return maxInFlightBytes_; }
+
+	//parse every file. Returns how many were parsed.
+	unsigned Run();
+
+	//of the last Run()
+	unsigned GetNumParsed() const { return numParsed_; }
+	unsigned GetNumFailed() const { return numFailed_; }
+	DxfOffset GetBytesRead() const { return bytesRead_; }
+	//the most bytes in flight at once
+	DxfOffset GetPeakInFlightBytes() const { return peakInFlightBytes_; }
+
+private:
+	//a file between its start and its callback
+	struct Job
+	{
+		DxfBatchResult result_;
+		SharedPtr<DxfReader> reader_;
+		//the bytes it holds while in flight
+		DxfOffset memory_;
+		//an LZ4 frame, and what it expanded to. The reader parses from the buffer.
+		bool compressed_;
+		SharedArrayPtr<char> expanded_;
+		DxfOffset expandedSize_;
+		bool parsed_;
+	};
+
+	static void ExpandWork(const WorkItem* item, unsigned threadIndex);
+	static void ParseWork(const WorkItem* item, unsigned threadIndex);
+
+	//the size of a file and what it holds in flight, false if it can not be read
+	bool Measure(Job& job, const String& path);
+	//hand a job to the workers, to be expanded or parsed
+	void Submit(WorkQueue* queue, Job& job, void (*work)(const WorkItem*, unsigned));
+	void Finish(Job& job);
+	//jobs the workers are done with, in the order they were done
+	void TakeFinished(PODVector<Job*>& finished);
+
+	Vector<String> paths_;
+	DxfBatchCallback callback_;
+	void* userData_;
+	DxfOffset maxInFlightBytes_;
+
+	//filled by the workers
+	Mutex finishedMutex_;
+	PODVector<Job*> finished_;
+
+	unsigned numParsed_;
+	unsigned numFailed_;
+	DxfOffset bytesRead_;
+	DxfOffset peakInFlightBytes_;
+};
@@ -0,0 +1,177 @@
+#include "DxfBoundsQuery.h"
+
+DxfBoundsQuery::DxfBoundsQuery() :
+	mode_(QUERY_NONE),
+	target_(0),
+	culled_(0),
+	polyline_(DXF_POLYLINE)
+{
+}
+
+void DxfBoundsQuery::SetBox(const BoundingBox& box)
+{
+	box_ = box;
+	mode_ = QUERY_BOX;
+}
+
+void DxfBoundsQuery::SetFrustum(const Frustum& frustum)
+{
+	frustum_ = frustum;
+	mode_ = QUERY_FRUSTUM;
+}
+
+void DxfBoundsQuery::Clear()
+{
+	mode_ = QUERY_NONE;
+}
+
+bool DxfBoundsQuery::Intersects(const BoundingBox& bounds) const
+{
+	if (!bounds.Defined())
+		return true;
+
+	switch (mode_)
+	{
+	case QUERY_BOX:
+		return box_.IsInside(bounds) != OUTSIDE;
+
+	case QUERY_FRUSTUM:
+		return frustum_.IsInside(bounds) != OUTSIDE;
+
+	default:
+		return true;
+	}
+}
+
+void DxfBoundsQuery::SetTarget(DxfEntityHandler* target)
+{
+	target_ = target;
+	culled_ = 0;
+	bounds_.Clear();
+	positions_.Clear();
+	indices_.Clear();
+	numIndices_.Clear();
+	precise_.Clear();
+}
+
+void DxfBoundsQuery::FlushPrecise()
+{
+	if (!precise_.Empty())
+		target_->OnPrecisePositions(&precise_[0], precise_.Size());
+
+	precise_.Clear();
+}
+
+void DxfBoundsQuery::OnPoint(const DxfEntity& entity, const Vector3& position)
+{
+	bounds_.Merge(position);
+
+	if (Intersects(BoundingBox(position, position)))
+	{
+		FlushPrecise();
+		target_->OnPoint(entity, position);
+	}
+	else
+	{
+		precise_.Clear();
+		++culled_;
+	}
+}
+
+void DxfBoundsQuery::OnPolylineBegin(const DxfEntity& entity)
+{
+	if (!IsActive())
+	{
+		target_->OnPolylineBegin(entity);
+		return;
+	}
+
+	polyline_ = entity;
+	positions_.Clear();
+	indices_.Clear();
+	numIndices_.Clear();
+	precise_.Clear();
+}
+
+void DxfBoundsQuery::OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices)
+{
+	bounds_.Merge(position);
+
+	if (!IsActive())
+	{
+		target_->OnPolylineVertex(entity, position, indices, numIndices);
+		return;
+	}
+
+	positions_.Push(position);
+	numIndices_.Push(numIndices);
+
+	unsigned start = indices_.Size();
+	indices_.Resize(start + 4);
+	for (unsigned i = 0; i < 4; ++i)
+		indices_[start + i] = i < numIndices ? indices[i] : 0;
+}
+
+void DxfBoundsQuery::OnPolylineEnd(const DxfEntity& entity)
+{
+	if (!IsActive())
+	{
+		target_->OnPolylineEnd(entity);
+		return;
+	}
+
+	if (!Intersects(bounds_))
+	{
+		++culled_;
+		precise_.Clear();
+		return;
+	}
+
+	//replay with the counts the reader had at each vertex
+	bool precise = precise_.Size() == positions_.Size();
+	DxfEntity polyline = polyline_;
+	target_->OnPolylineBegin(polyline);
+
+	for (unsigned i = 0; i < positions_.Size(); ++i)
+	{
+		if (precise)
+			target_->OnPrecisePositions(&precise_[i], 1);
+
+		target_->OnPolylineVertex(polyline, positions_[i], &indices_[i * 4], numIndices_[i]);
+		++polyline.vertexCount_;
+		polyline.indexCount_ += numIndices_[i];
+	}
+
+	precise_.Clear();
+	target_->OnPolylineEnd(entity);
+}
+
+void DxfBoundsQuery::On3DFace(const DxfEntity& entity, const Vector3* corners)
+{
+	BoundingBox face(corners, 4);
+	bounds_.Merge(face);
+
+	if (Intersects(face))
+	{
+		FlushPrecise();
+		target_->On3DFace(entity, corners);
+	}
+	else
+	{
+		precise_.Clear();
+		++culled_;
+	}
+}
+
+void DxfBoundsQuery::OnPrecisePositions(const DxfVector3d* positions, unsigned count)
+{
+	//without a region nothing is held back
+	if (!IsActive())
+	{
+		target_->OnPrecisePositions(positions, count);
+		return;
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+		precise_.Push(positions[i]);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Container/Vector.h"
+#include "Math/BoundingBox.h"
+#include "Math/Frustum.h"
+#include "DxfDocument.h"
+#include "DxfEntityHandler.h"
+#include "DxfTokenizer.h"
+
+using namespace Urho3D;
+
+//bounds of a top-level entity of ENTITIES, by the offset of its 0 group. Undefined when it brought no positions.
+struct DxfEntityBounds
+{
+	DxfEntityBounds() :
+		offset_(0)
+	{
+	}
+
+	DxfEntityBounds(DxfOffset offset, const BoundingBox& bounds) :
+		offset_(offset),
+		bounds_(bounds)
+	{
+	}
+
+	DxfOffset offset_;
+	BoundingBox bounds_;
+};
+
+/**************************************************************************
+A spatial query between the reader and a handler. It takes a box or a
+frustum, measures each entity that comes through, and passes on only the
+ones that meet the region:
+ ---- points and faces are decided at once
+ ---- polylines are held back until OnPolylineEnd(), then passed on whole
+Precise positions go along with the call they belong to. Without a region
+everything is passed on straight away, and only measured.
+
+BeginEntity() starts the bounds of the next entity over; GetBounds()
+covers all positions it brought, whether it was passed on or not.
+***************************************************************************/
+class DxfBoundsQuery : public DxfEntityHandler
+{
+public:
+	DxfBoundsQuery();
+
+	//the region. Setting one replaces the other.
+	void SetBox(const BoundingBox& box);
+	void SetFrustum(const Frustum& frustum);
+	void Clear();
+	bool IsActive() const { return mode_ != QUERY_NONE; }
+	//whether bounds meet the region. Undefined bounds always do, as does any without a region.
+	bool Intersects(const BoundingBox& bounds) const;
+
+	//the handler that gets what meets the region. Also resets the count of culled entities.
+	void SetTarget(DxfEntityHandler* target);
+	void BeginEntity() { bounds_.Clear(); }
+	const BoundingBox& GetBounds() const { return bounds_; }
+	//entities that did not meet the region since SetTarget()
+	unsigned GetNumCulled() const { return culled_; }
+
+	//DxfEntityHandler
+	virtual void OnPoint(const DxfEntity& entity, const Vector3& position);
+	virtual void OnPolylineBegin(const DxfEntity& entity);
+	virtual void OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices);
+	virtual void OnPolylineEnd(const DxfEntity& entity);
+	virtual void On3DFace(const DxfEntity& entity, const Vector3* corners);
+	virtual void OnPrecisePositions(const DxfVector3d* positions, unsigned count);
+
+private:
+	enum QueryMode
+	{
+		QUERY_NONE = 0,
+		QUERY_BOX,
+		QUERY_FRUSTUM
+	};
+
+	//pass the precise positions held back on to the target
+	void FlushPrecise();
+
+	QueryMode mode_;
+	BoundingBox box_;
+	Frustum frustum_;
+	DxfEntityHandler* target_;
+	BoundingBox bounds_;
+	unsigned culled_;
+
+	//the polyline held back, 4 index slots per vertex
+	DxfEntity polyline_;
+	PODVector<Vector3> positions_;
+	PODVector<int> indices_;
+	PODVector<unsigned> numIndices_;
+	PODVector<DxfVector3d> precise_;
+};
@@ -0,0 +1,126 @@
+#include "DxfCache.h"
+#include "DxfCompression.h"
+#include "DxfDocument.h"
+
+#include "Core/Context.h"
+#include "IO/File.h"
+#include "IO/FileSystem.h"
+#include "IO/MappedFile.h"
+#include "IO/MemoryBuffer.h"
+
+#include <cstring>
+
+unsigned long long DxfContentHash(const void* data, DxfOffset size, unsigned long long seed)
+{
+	const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	const unsigned char* end = bytes + (size & ~(DxfOffset)7);
+	unsigned long long h = seed ^ (size * m);
+
+	for (; bytes != end; bytes += 8)
+	{
+		unsigned long long k;
+		memcpy(&k, bytes, 8);
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	switch (size & 7)
+	{
+	case 7: h ^= (unsigned long long)bytes[6] << 48; //fall through
+	case 6: h ^= (unsigned long long)bytes[5] << 40; //fall through
+	case 5: h ^= (unsigned long long)bytes[4] << 32; //fall through
+	case 4: h ^= (unsigned long long)bytes[3] << 24; //fall through
+	case 3: h ^= (unsigned long long)bytes[2] << 16; //fall through
+	case 2: h ^= (unsigned long long)bytes[1] << 8; //fall through
+	case 1: h ^= (unsigned long long)bytes[0];
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+bool SaveDxfCache(Context* context, const String& path, const DxfCacheKey& key, const DxfDocument& document, bool compress)
+{
+	FileSystem* fileSystem = context->GetSubsystem<FileSystem>();
+	if (!fileSystem)
+		return false;
+
+	//the blob only takes its place once it is complete
+	String temporary = path + ".tmp";
+	bool written;
+	{
+		File file(context, temporary, FILE_WRITE);
+		if (!file.IsOpen())
+			return false;
+
+		written = file.WriteFileID("DXFC");
+		written &= file.WriteUInt(DXF_CACHE_VERSION);
+		written &= file.WriteUInt64(key.size_);
+		written &= file.WriteUInt(key.modified_);
+		written &= file.WriteUInt64(key.hash_);
+		written &= file.WriteUInt64(key.options_);
+		written &= file.WriteBool(compress);
+
+		if (written && compress)
+		{
+			DxfCompressor compressor(file);
+			written = document.Save(compressor) && compressor.Finish();
+		}
+		else if (written)
+			written = document.Save(file);
+	}
+
+	//rename does not replace a file everywhere
+	if (written && fileSystem->FileExists(path))
+		fileSystem->Delete(path);
+	if (!written || !fileSystem->Rename(temporary, path))
+	{
+		fileSystem->Delete(temporary);
+		return false;
+	}
+
+	return true;
+}
+
+bool LoadDxfCache(const String& path, const DxfCacheKey& key, DxfDocument& document)
+{
+	MappedFile mapping(path);
+	if (!mapping.IsOpen() || mapping.GetSize() >= M_MAX_UNSIGNED)
+		return false;
+
+	MemoryBuffer blob(mapping.GetData(), (unsigned)mapping.GetSize());
+	if (blob.ReadFileID() != "DXFC" || blob.ReadUInt() != DXF_CACHE_VERSION)
+		return false;
+
+	DxfCacheKey stored;
+	stored.size_ = blob.ReadUInt64();
+	stored.modified_ = blob.ReadUInt();
+	stored.hash_ = blob.ReadUInt64();
+	stored.options_ = blob.ReadUInt64();
+	if (stored != key)
+		return false;
+
+	if (!blob.ReadBool())
+		return document.Load(blob);
+
+	SharedArrayPtr<char> snapshot;
+	DxfOffset snapshotSize = 0;
+	if (!DecompressDxf(mapping.GetData() + blob.GetPosition(), blob.GetSize() - blob.GetPosition(), snapshot, snapshotSize) ||
+		snapshotSize >= M_MAX_UNSIGNED)
+		return false;
+
+	MemoryBuffer expanded(snapshot.Get(), (unsigned)snapshotSize);
+	return document.Load(expanded);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Container/Str.h"
+#include "DxfTokenizer.h"
+
+namespace Urho3D
+{
+	class Context;
+}
+
+class DxfDocument;
+
+using namespace Urho3D;
+
+/**************************************************************************
+Parse cache. A blob holds a DxfDocument snapshot (DxfDocument::Save())
+behind a small header:
+ ---- "DXFC"                <- file id
+ ---- DXF_CACHE_VERSION     <- uint, blobs of other versions are ignored
+ ---- DxfCacheKey           <- what the blob was made from
+ ---- compressed            <- bool, the snapshot is then an LZ4 frame (DxfCompression.h)
+ ---- snapshot
+
+Blobs are mapped to load them. An uncompressed snapshot is read straight
+from the mapping, one copy per array; a compressed one is expanded with
+the checked decoder, so a damaged blob fails to load. Blobs of 4GB and
+more are not loaded.
+
+A blob is written beside its place and renamed into it once complete, so
+a write that is cut short leaves the old blob, or none.
+***************************************************************************/
+static const unsigned DXF_CACHE_VERSION = 2;
+
+//what a blob was made from
+struct DxfCacheKey
+{
+	DxfCacheKey() :
+		size_(0),
+		modified_(0),
+		hash_(0),
+		options_(0)
+	{
+	}
+
+	bool operator ==(const DxfCacheKey& rhs) const
+	{
+		return size_ == rhs.size_ && modified_ == rhs.modified_ && hash_ == rhs.hash_ && options_ == rhs.options_;
+	}
+
+	bool operator !=(const DxfCacheKey& rhs) const { return !(*this == rhs); }
+
+	//the source: its size, modification time (0 for a buffer) and DxfContentHash()
+	DxfOffset size_;
+	unsigned modified_;
+	unsigned long long hash_;
+	//reader settings that change the document, eg. the origin
+	unsigned long long options_;
+};
+
+//fast 64-bit hash of a whole buffer, 8 bytes at a time (MurmurHash64A)
+unsigned long long DxfContentHash(const void* data, DxfOffset size, unsigned long long seed = 0);
+
+//false if the blob could not be written whole
+bool SaveDxfCache(Context* context, const String& path, const DxfCacheKey& key, const DxfDocument& document, bool compress = false);
+//false, leaving the document empty, if there is no blob for the key
+bool LoadDxfCache(const String& path, const DxfCacheKey& key, DxfDocument& document);
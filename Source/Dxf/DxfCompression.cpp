@@ -0,0 +1,224 @@
+#include "DxfCompression.h"
+
+#include "Core/WorkQueue.h"
+#include "IO/File.h"
+
+#include <LZ4/lz4.h>
+#include <cstring>
+
+namespace
+{
+	const unsigned FRAME_HEADER_SIZE = DXF_LZ4_MAGIC_LENGTH + sizeof(unsigned);
+	const unsigned BLOCK_HEADER_SIZE = 2 * sizeof(unsigned);
+
+	//one block of a frame, where it is and where it goes
+	struct DxfBlockJob
+	{
+		const char* packed_;
+		char* unpacked_;
+		unsigned packedSize_;
+		unsigned unpackedSize_;
+		bool failed_;
+	};
+
+	unsigned ReadUInt(const unsigned char* data)
+	{
+		unsigned value;
+		memcpy(&value, data, sizeof value);
+		return value;
+	}
+
+	void DecompressBlock(DxfBlockJob& job)
+	{
+		//the input may be damaged, so only the safe decoder will do
+		int size = LZ4_decompress_safe(job.packed_, job.unpacked_, (int)job.packedSize_, (int)job.unpackedSize_);
+		job.failed_ = size != (int)job.unpackedSize_;
+	}
+
+	void DecompressBlockWork(const WorkItem* item, unsigned threadIndex)
+	{
+		DxfBlockJob* job = reinterpret_cast<DxfBlockJob*>(item->start_);
+		DxfBlockJob* end = reinterpret_cast<DxfBlockJob*>(item->end_);
+		for (; job < end; ++job)
+			DecompressBlock(*job);
+	}
+
+	//walk the block headers: the total size, and where each block is when jobs are wanted.
+	//Fails on headers that are out of bounds, before anything is allocated.
+	bool ReadBlockHeaders(const void* data, DxfOffset size, PODVector<DxfBlockJob>* jobs, DxfOffset& unpackedSize)
+	{
+		unpackedSize = 0;
+		if (!IsDxfCompressed(data, size))
+			return false;
+
+		const unsigned char* begin = (const unsigned char*)data;
+		const unsigned char* end = begin + (size_t)size;
+		unsigned blockSize = ReadUInt(begin + DXF_LZ4_MAGIC_LENGTH);
+		if (!blockSize || blockSize > DXF_LZ4_MAX_BLOCK_SIZE)
+			return false;
+
+		for (const unsigned char* cursor = begin + FRAME_HEADER_SIZE; cursor < end;)
+		{
+			if ((DxfOffset)(end - cursor) < BLOCK_HEADER_SIZE)
+				return false;
+
+			DxfBlockJob job;
+			job.unpackedSize_ = ReadUInt(cursor);
+			job.packedSize_ = ReadUInt(cursor + sizeof(unsigned));
+			job.packed_ = (const char*)cursor + BLOCK_HEADER_SIZE;
+			job.unpacked_ = 0;
+			job.failed_ = false;
+
+			if (job.unpackedSize_ > blockSize || (DxfOffset)(end - cursor) - BLOCK_HEADER_SIZE < job.packedSize_)
+				return false;
+			//more than LZ4 can make of the packed bytes
+			if (job.unpackedSize_ > (DxfOffset)job.packedSize_ * DXF_LZ4_MAX_RATIO)
+				return false;
+
+			if (jobs)
+				jobs->Push(job);
+			unpackedSize += job.unpackedSize_;
+			cursor += BLOCK_HEADER_SIZE + job.packedSize_;
+		}
+
+		return true;
+	}
+}
+
+bool IsDxfCompressed(const void* data, DxfOffset size)
+{
+	return size >= FRAME_HEADER_SIZE && !memcmp(data, DXF_LZ4_MAGIC, DXF_LZ4_MAGIC_LENGTH);
+}
+
+bool IsDxfCompressedFile(Context* context, const String& path)
+{
+	SharedPtr<File> file(new File(context));
+	if (!file->Open(path))
+		return false;
+
+	unsigned char header[FRAME_HEADER_SIZE];
+	return file->Read(header, FRAME_HEADER_SIZE) == FRAME_HEADER_SIZE && IsDxfCompressed(header, FRAME_HEADER_SIZE);
+}
+
+bool GetDxfUnpackedSize(const void* data, DxfOffset size, DxfOffset& unpackedSize)
+{
+	return ReadBlockHeaders(data, size, 0, unpackedSize);
+}
+
+bool DecompressDxf(const void* data, DxfOffset size, SharedArrayPtr<char>& dest, DxfOffset& destSize, WorkQueue* queue)
+{
+	PODVector<DxfBlockJob> jobs;
+	if (!ReadBlockHeaders(data, size, &jobs, destSize))
+	{
+		destSize = 0;
+		return false;
+	}
+
+	dest = new char[(size_t)destSize];
+
+	DxfOffset offset = 0;
+	for (unsigned i = 0; i < jobs.Size(); ++i)
+	{
+		jobs[i].unpacked_ = dest.Get() + (size_t)offset;
+		offset += jobs[i].unpackedSize_;
+	}
+
+	//a few blocks per work item keeps the queue overhead small
+	const unsigned blocksPerItem = 4;
+	if (queue && jobs.Size() > blocksPerItem)
+	{
+		for (unsigned i = 0; i < jobs.Size(); i += blocksPerItem)
+		{
+			SharedPtr<WorkItem> item = queue->GetFreeItem();
+			item->priority_ = M_MAX_UNSIGNED;
+			item->workFunction_ = DecompressBlockWork;
+			item->start_ = &jobs[i];
+			item->end_ = &jobs[0] + Min(i + blocksPerItem, jobs.Size());
+			queue->AddWorkItem(item);
+		}
+
+		queue->Complete(M_MAX_UNSIGNED);
+	}
+	else
+	{
+		for (unsigned i = 0; i < jobs.Size(); ++i)
+			DecompressBlock(jobs[i]);
+	}
+
+	for (unsigned i = 0; i < jobs.Size(); ++i)
+	{
+		if (jobs[i].failed_)
+		{
+			dest.Reset();
+			destSize = 0;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+DxfCompressor::DxfCompressor(Serializer& dest, unsigned blockSize) :
+	dest_(dest),
+	blockSize_(Clamp(blockSize, 1u, DXF_LZ4_MAX_BLOCK_SIZE)),
+	failed_(false),
+	finished_(false)
+{
+	block_.Reserve(blockSize_);
+	packed_.Resize((unsigned)LZ4_compressBound((int)blockSize_));
+
+	failed_ = dest_.Write(DXF_LZ4_MAGIC, DXF_LZ4_MAGIC_LENGTH) != DXF_LZ4_MAGIC_LENGTH || !dest_.WriteUInt(blockSize_);
+}
+
+DxfCompressor::~DxfCompressor()
+{
+	Finish();
+}
+
+unsigned DxfCompressor::Write(const void* data, unsigned size)
+{
+	if (failed_ || finished_)
+		return 0;
+
+	const unsigned char* source = (const unsigned char*)data;
+	unsigned left = size;
+
+	while (left)
+	{
+		unsigned copy = Min(left, blockSize_ - block_.Size());
+		unsigned start = block_.Size();
+		block_.Resize(start + copy);
+		memcpy(&block_[start], source, copy);
+		source += copy;
+		left -= copy;
+
+		if (block_.Size() == blockSize_ && !WriteBlock())
+			return size - left;
+	}
+
+	return size;
+}
+
+bool DxfCompressor::Finish()
+{
+	if (!finished_)
+	{
+		if (!block_.Empty())
+			WriteBlock();
+		finished_ = true;
+	}
+
+	return !failed_;
+}
+
+bool DxfCompressor::WriteBlock()
+{
+	int packedSize = LZ4_compress_default((const char*)block_.Buffer(), (char*)packed_.Buffer(), (int)block_.Size(), (int)packed_.Size());
+
+	if (packedSize <= 0 || !dest_.WriteUInt(block_.Size()) || !dest_.WriteUInt((unsigned)packedSize)
+		|| dest_.Write(packed_.Buffer(), (unsigned)packedSize) != (unsigned)packedSize)
+		failed_ = true;
+
+	block_.Clear();
+	return !failed_;
+}
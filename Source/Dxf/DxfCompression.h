@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Container/ArrayPtr.h"
+#include "Container/Vector.h"
+#include "IO/Serializer.h"
+#include "DxfTokenizer.h"
+
+namespace Urho3D
+{
+	class Context;
+	class WorkQueue;
+}
+
+using namespace Urho3D;
+
+/**************************************************************************
+LZ4 framing for archived DXF files (.dxf.lz4):
+ ---- DXF_LZ4_MAGIC                      <- 8 bytes
+ ---- block size                         <- uint, the largest unpacked block
+ ---- unpacked size, packed size, data   <- per block, until the end
+
+Blocks are compressed on their own, so they can be expanded in any order
+and on several threads.
+***************************************************************************/
+static const char DXF_LZ4_MAGIC[] = "DXFLZ4\x1a";
+static const unsigned DXF_LZ4_MAGIC_LENGTH = sizeof(DXF_LZ4_MAGIC);
+static const unsigned DXF_LZ4_BLOCK_SIZE = 1 << 20;
+//frames with larger blocks are taken as damaged
+static const unsigned DXF_LZ4_MAX_BLOCK_SIZE = 64 << 20;
+//LZ4 can not expand a block by more than this
+static const unsigned DXF_LZ4_MAX_RATIO = 255;
+
+//whether a buffer, or the start of a file, holds an LZ4 frame
+bool IsDxfCompressed(const void* data, DxfOffset size);
+bool IsDxfCompressedFile(Context* context, const String& path);
+//what a frame expands to, read from its block headers. False for a damaged frame.
+bool GetDxfUnpackedSize(const void* data, DxfOffset size, DxfOffset& unpackedSize);
+
+//expand a whole frame into dest. The blocks are spread over the WorkQueue when one is given.
+//A damaged frame fails before anything is allocated when its headers are out of bounds, or while decoding.
+bool DecompressDxf(const void* data, DxfOffset size, SharedArrayPtr<char>& dest, DxfOffset& destSize, WorkQueue* queue = 0);
+
+//writes an LZ4 frame to another stream, one block at a time
+class DxfCompressor : public Serializer
+{
+public:
+	//blockSize is kept within DXF_LZ4_MAX_BLOCK_SIZE
+	DxfCompressor(Serializer& dest, unsigned blockSize = DXF_LZ4_BLOCK_SIZE);
+	~DxfCompressor();
+
+	virtual unsigned Write(const void* data, unsigned size);
+
+	//compress what is left. Call once, before the destination is closed.
+	bool Finish();
+
+private:
+	bool WriteBlock();
+
+	Serializer& dest_;
+	unsigned blockSize_;
+	PODVector<unsigned char> block_;
+	PODVector<unsigned char> packed_;
+	bool failed_;
+	bool finished_;
+};
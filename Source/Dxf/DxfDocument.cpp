@@ -0,0 +1,728 @@
+#include "DxfDocument.h"
+#include "IO/Deserializer.h"
+#include "IO/Serializer.h"
+
+#include <cstring>
+
+namespace
+{
+	//largest POLYLINE count hint that is trusted for preallocation
+	const unsigned MAX_HINT = 1 << 24;
+
+	//make room for more elements. Never less than the usual growth, so many small reservations stay amortized.
+	template <class T> bool Grow(PODVector<T>& vector, unsigned more)
+	{
+		unsigned needed = vector.Size() + more;
+		if (needed <= vector.Capacity())
+			return false;
+
+		unsigned capacity = vector.Capacity() + (vector.Capacity() + 1) / 2;
+		vector.Reserve(needed > capacity ? needed : capacity);
+		return true;
+	}
+
+	//the flat arrays of a snapshot: a count, then the elements as they are in memory
+	template <class T> bool WriteArray(Serializer& dest, const PODVector<T>& vector)
+	{
+		if (!dest.WriteUInt(vector.Size()))
+			return false;
+		return vector.Empty() || dest.Write(&vector[0], vector.Size() * sizeof(T)) == vector.Size() * sizeof(T);
+	}
+
+	template <class T> bool ReadArray(Deserializer& source, PODVector<T>& vector)
+	{
+		unsigned size = source.ReadUInt();
+		if ((unsigned long long)size * sizeof(T) > source.GetSize() - source.GetPosition())
+			return false;
+
+		vector.Resize(size);
+		return !size || source.Read(&vector[0], size * sizeof(T)) == size * sizeof(T);
+	}
+
+	//about to grow on the next Push()?
+	template <class T> inline bool IsFull(const PODVector<T>& vector)
+	{
+		return vector.Size() == vector.Capacity();
+	}
+}
+
+DxfDocument::DxfDocument() :
+	lastLayer_(DXF_NO_LAYER),
+	currentPolyline_(0),
+	reallocations_(0)
+{
+}
+
+void DxfDocument::Clear()
+{
+	entities_.Clear();
+	vertices_.Clear();
+	indices_.Clear();
+	preciseVertices_.Clear();
+	origin_ = DxfVector3d();
+	layers_.Clear();
+	layerIds_.Clear();
+	lastLayer_ = DXF_NO_LAYER;
+	reallocations_ = 0;
+	header_ = DxfHeader();
+	blocks_.Clear();
+	insertions_.Clear();
+	instances_.Clear();
+}
+
+void DxfDocument::Append(const DxfDocument& other)
+{
+	unsigned vertexOffset = vertices_.Size();
+	unsigned indexOffset = indices_.Size();
+
+	//layers are interned again, so ids follow the order of first appearance across both documents
+	PODVector<unsigned> layerIds(other.layers_.Size());
+	for (unsigned i = 0; i < other.layers_.Size(); ++i)
+		layerIds[i] = AddLayer(other.layers_[i].CString(), other.layers_[i].Length());
+
+	reallocations_ += Grow(entities_, other.entities_.Size());
+	reallocations_ += Grow(vertices_, other.vertices_.Size());
+	reallocations_ += Grow(indices_, other.indices_.Size());
+
+	unsigned first = entities_.Size();
+	entities_.Push(other.entities_);
+	for (unsigned i = first; i < entities_.Size(); ++i)
+	{
+		DxfEntity& entity = entities_[i];
+		entity.vertexStart_ += vertexOffset;
+		entity.indexStart_ += indexOffset;
+		if (entity.layer_ != DXF_NO_LAYER)
+			entity.layer_ = layerIds[entity.layer_];
+	}
+
+	vertices_.Push(other.vertices_);
+	indices_.Push(other.indices_);
+	preciseVertices_.Push(other.preciseVertices_);
+
+	//the header comes from the start of the file, so ours wins
+	if (!header_.fields_)
+		header_ = other.header_;
+	unsigned blockOffset = blocks_.Size();
+	blocks_.Push(other.blocks_);
+	for (unsigned i = blockOffset; i < blocks_.Size(); ++i)
+		blocks_[i].entityStart_ += first;
+
+	unsigned firstInsertion = insertions_.Size();
+	insertions_.Push(other.insertions_);
+	for (unsigned i = firstInsertion; i < insertions_.Size(); ++i)
+	{
+		if (insertions_[i].parent_ != DXF_NO_BLOCK)
+			insertions_[i].parent_ += blockOffset;
+	}
+
+	unsigned firstInstance = instances_.Size();
+	instances_.Push(other.instances_);
+	for (unsigned i = firstInstance; i < instances_.Size(); ++i)
+	{
+		instances_[i].block_ += blockOffset;
+		instances_[i].insertion_ += firstInsertion;
+	}
+}
+
+unsigned DxfDocument::AddLayer(const char* name, unsigned length)
+{
+	//fast path: same layer as the previous entity
+	if (lastLayer_ != DXF_NO_LAYER)
+	{
+		const String& last = layers_[lastLayer_];
+		if (last.Length() == length && !memcmp(last.CString(), name, length))
+			return lastLayer_;
+	}
+
+	String layerName(name, length);
+	HashMap<String, unsigned>::ConstIterator i = layerIds_.Find(layerName);
+	if (i != layerIds_.End())
+	{
+		lastLayer_ = i->second_;
+		return lastLayer_;
+	}
+
+	lastLayer_ = layers_.Size();
+	layers_.Push(layerName);
+	layerIds_[layerName] = lastLayer_;
+
+	return lastLayer_;
+}
+
+const String& DxfDocument::GetLayerName(unsigned layer) const
+{
+	return layer < layers_.Size() ? layers_[layer] : String::EMPTY;
+}
+
+void DxfDocument::Reserve(unsigned numEntities, unsigned numVertices, unsigned numIndices)
+{
+	reallocations_ += Grow(entities_, numEntities);
+	reallocations_ += Grow(vertices_, numVertices);
+	reallocations_ += Grow(indices_, numIndices);
+}
+
+DxfEntity& DxfDocument::AddEntity(const DxfEntity& header)
+{
+	reallocations_ += IsFull(entities_);
+	entities_.Push(header);
+
+	DxfEntity& entity = entities_.Back();
+	entity.vertexStart_ = vertices_.Size();
+	entity.vertexCount_ = 0;
+	entity.indexStart_ = indices_.Size();
+	entity.indexCount_ = 0;
+
+	return entity;
+}
+
+unsigned DxfDocument::CopyEntity(const DxfDocument& source, unsigned index)
+{
+	const DxfEntity& original = source.entities_[index];
+	unsigned copy = entities_.Size();
+
+	DxfEntity& entity = AddEntity(original);
+	if (original.layer_ != DXF_NO_LAYER)
+		entity.layer_ = AddLayer(source.layers_[original.layer_].CString(), source.layers_[original.layer_].Length());
+
+	if (original.vertexCount_)
+	{
+		reallocations_ += Grow(vertices_, original.vertexCount_);
+		vertices_.Push(PODVector<Vector3>(&source.vertices_[original.vertexStart_], original.vertexCount_));
+		if (original.vertexStart_ + original.vertexCount_ <= source.preciseVertices_.Size())
+			preciseVertices_.Push(PODVector<DxfVector3d>(&source.preciseVertices_[original.vertexStart_], original.vertexCount_));
+		entity.vertexCount_ = original.vertexCount_;
+	}
+
+	if (original.indexCount_)
+	{
+		reallocations_ += Grow(indices_, original.indexCount_);
+		indices_.Push(PODVector<int>(&source.indices_[original.indexStart_], original.indexCount_));
+		entity.indexCount_ = original.indexCount_;
+	}
+
+	return copy;
+}
+
+void DxfDocument::AddVertex(DxfEntity& entity, const Vector3& vertex)
+{
+	reallocations_ += IsFull(vertices_);
+	vertices_.Push(vertex);
+	++entity.vertexCount_;
+}
+
+void DxfDocument::AddIndex(DxfEntity& entity, int index)
+{
+	reallocations_ += IsFull(indices_);
+	indices_.Push(index);
+	++entity.indexCount_;
+}
+
+void DxfDocument::OnPoint(const DxfEntity& entity, const Vector3& position)
+{
+	AddVertex(AddEntity(entity), position);
+}
+
+void DxfDocument::OnPolylineBegin(const DxfEntity& entity)
+{
+	//a polyface mesh has a VERTEX record for each vertex (71) and each face (72), and up to 4 indices per face
+	//the hints come from the file, so a broken one must not reserve gigabytes
+	unsigned numVertices = entity.fields_ & DXF_FIELD_VERTICES_HINT ? Min(entity.verticesHint_, MAX_HINT) : 0;
+	unsigned numFaces = entity.fields_ & DXF_FIELD_FACES_HINT ? Min(entity.facesHint_, MAX_HINT) : 0;
+	reallocations_ += Grow(vertices_, numVertices + numFaces);
+	reallocations_ += Grow(indices_, numFaces * 4);
+
+	currentPolyline_ = entities_.Size();
+	AddEntity(entity);
+}
+
+void DxfDocument::OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices)
+{
+	DxfEntity& polyline = entities_[currentPolyline_];
+
+	for (unsigned i = 0; i < numIndices; ++i)
+		AddIndex(polyline, indices[i]);
+
+	AddVertex(polyline, position);
+}
+
+void DxfDocument::OnPolylineEnd(const DxfEntity& entity)
+{
+	//header groups may have been updated since OnPolylineBegin(); the ranges are ours
+	DxfEntity& polyline = entities_[currentPolyline_];
+	polyline.fields_ = entity.fields_;
+	polyline.layer_ = entity.layer_;
+	polyline.flags_ = entity.flags_;
+	polyline.verticesHint_ = entity.verticesHint_;
+	polyline.facesHint_ = entity.facesHint_;
+}
+
+void DxfDocument::On3DFace(const DxfEntity& entity, const Vector3* corners)
+{
+	DxfEntity& face = AddEntity(entity);
+
+	for (unsigned i = 0; i < 4; ++i)
+		AddVertex(face, corners[i]);
+}
+
+void DxfDocument::OnPrecisePositions(const DxfVector3d* positions, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+		preciseVertices_.Push(positions[i]);
+}
+
+DxfVector3d DxfDocument::GetWorldVertex(unsigned index) const
+{
+	if (index < preciseVertices_.Size())
+		return preciseVertices_[index];
+
+	const Vector3& vertex = vertices_[index];
+	return origin_ + DxfVector3d(vertex.x_, vertex.y_, vertex.z_);
+}
+
+unsigned DxfDocument::ResolveInsertions()
+{
+	instances_.Clear();
+
+	HashMap<String, unsigned> blockIds;
+	for (unsigned i = 0; i < blocks_.Size(); ++i)
+	{
+		if (!blocks_[i].generic_)
+			blockIds[blocks_[i].name_] = i;
+	}
+
+	//the dependency graph: the block each INSERT names, and the INSERTs inside each block
+	PODVector<unsigned> targets(insertions_.Size());
+	Vector<PODVector<unsigned> > children(blocks_.Size());
+	unsigned dropped = 0;
+
+	for (unsigned i = 0; i < insertions_.Size(); ++i)
+	{
+		HashMap<String, unsigned>::ConstIterator block = blockIds.Find(insertions_[i].name_);
+		targets[i] = block != blockIds.End() ? block->second_ : DXF_NO_BLOCK;
+
+		if (targets[i] == DXF_NO_BLOCK)
+			++dropped;
+		else if (insertions_[i].parent_ < blocks_.Size())
+			children[insertions_[i].parent_].Push(i);
+	}
+
+	//expand the blocks children first, each once. The expansion of a block lists the blocks with geometry
+	//it places, itself included, with transforms into its own coordinates.
+	Vector<PODVector<DxfInstance> > expanded(blocks_.Size());
+	PODVector<unsigned char> state(blocks_.Size());
+	for (unsigned i = 0; i < state.Size(); ++i)
+		state[i] = 0;
+
+	for (unsigned root = 0; root < blocks_.Size(); ++root)
+	{
+		if (state[root])
+			continue;
+
+		//depth first, without recursion: the stack holds blocks and how many of their children were visited
+		PODVector<Pair<unsigned, unsigned> > stack;
+		stack.Push(MakePair(root, 0u));
+		state[root] = 1;
+
+		while (!stack.Empty())
+		{
+			unsigned block = stack.Back().first_;
+			unsigned& next = stack.Back().second_;
+
+			if (next < children[block].Size())
+			{
+				unsigned insertion = children[block][next++];
+				unsigned target = targets[insertion];
+
+				//on the stack: this INSERT closes a cycle
+				if (state[target] == 1)
+				{
+					targets[insertion] = DXF_NO_BLOCK;
+					++dropped;
+				}
+				else if (!state[target])
+				{
+					state[target] = 1;
+					stack.Push(MakePair(target, 0u));
+				}
+				continue;
+			}
+
+			//all children are expanded, so this block is a concatenation of theirs
+			PODVector<DxfInstance>& list = expanded[block];
+			if (blocks_[block].entityCount_)
+			{
+				DxfInstance self;
+				self.block_ = block;
+				self.insertion_ = DXF_NO_BLOCK;
+				list.Push(self);
+			}
+
+			const PODVector<unsigned>& inserts = children[block];
+			for (unsigned i = 0; i < inserts.Size(); ++i)
+			{
+				unsigned target = targets[inserts[i]];
+				if (target == DXF_NO_BLOCK)
+					continue;
+
+				Matrix3x4 transform = GetInsertionTransform(inserts[i], target);
+				const PODVector<DxfInstance>& placed = expanded[target];
+				for (unsigned j = 0; j < placed.Size(); ++j)
+				{
+					DxfInstance instance;
+					instance.block_ = placed[j].block_;
+					instance.insertion_ = DXF_NO_BLOCK;
+					instance.transform_ = transform * placed[j].transform_;
+					list.Push(instance);
+				}
+			}
+
+			state[block] = 2;
+			stack.Pop();
+		}
+	}
+
+	//the drawing's own INSERTs
+	for (unsigned i = 0; i < insertions_.Size(); ++i)
+	{
+		unsigned target = targets[i];
+		if (insertions_[i].parent_ != DXF_NO_BLOCK || target == DXF_NO_BLOCK)
+			continue;
+
+		Matrix3x4 transform = GetInsertionTransform(i, target);
+		const PODVector<DxfInstance>& placed = expanded[target];
+		for (unsigned j = 0; j < placed.Size(); ++j)
+		{
+			DxfInstance instance;
+			instance.block_ = placed[j].block_;
+			instance.insertion_ = i;
+			instance.transform_ = transform * placed[j].transform_;
+			instances_.Push(instance);
+		}
+	}
+
+	return dropped;
+}
+
+Matrix3x4 DxfDocument::GetInsertionTransform(unsigned insertion, unsigned block) const
+{
+	const DxfInsertion& source = insertions_[insertion];
+
+	return Matrix3x4(source.position_, Quaternion(source.angle_, Vector3::FORWARD), source.scale_) *
+		Matrix3x4(-blocks_[block].base_, Quaternion::IDENTITY, Vector3::ONE);
+}
+
+void DxfDocument::TransformVertices(const Matrix3x4& transform, const Vector3* source, Vector3* dest, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+		dest[i] = transform * source[i];
+}
+
+void DxfDocument::Flatten(DxfDocument& dest) const
+{
+	for (unsigned i = 0; i < instances_.Size(); ++i)
+	{
+		const DxfInstance& instance = instances_[i];
+		const DxfBlock& block = blocks_[instance.block_];
+
+		for (unsigned j = block.entityStart_; j < block.entityStart_ + block.entityCount_; ++j)
+		{
+			const DxfEntity& source = entities_[j];
+
+			DxfEntity& entity = dest.AddEntity(source);
+			if (source.layer_ != DXF_NO_LAYER)
+				entity.layer_ = dest.AddLayer(layers_[source.layer_].CString(), layers_[source.layer_].Length());
+
+			//a whole range at once, straight into the destination array
+			if (source.vertexCount_)
+			{
+				unsigned start = dest.vertices_.Size();
+				dest.vertices_.Resize(start + source.vertexCount_);
+				TransformVertices(instance.transform_, &vertices_[source.vertexStart_], &dest.vertices_[start], source.vertexCount_);
+				entity.vertexCount_ = source.vertexCount_;
+			}
+
+			if (source.indexCount_)
+			{
+				dest.indices_.Push(PODVector<int>(&indices_[source.indexStart_], source.indexCount_));
+				entity.indexCount_ = source.indexCount_;
+			}
+		}
+	}
+}
+
+unsigned DxfDocument::GetMemoryUse() const
+{
+	unsigned bytes = entities_.Capacity() * sizeof(DxfEntity);
+	bytes += vertices_.Capacity() * sizeof(Vector3);
+	bytes += indices_.Capacity() * sizeof(int);
+	bytes += preciseVertices_.Capacity() * sizeof(DxfVector3d);
+	bytes += instances_.Capacity() * sizeof(DxfInstance);
+
+	for (unsigned i = 0; i < layers_.Size(); ++i)
+		bytes += layers_[i].Capacity() + sizeof(String);
+
+	return bytes;
+}
+
+bool DxfDocument::Save(Serializer& dest) const
+{
+	bool written = dest.WriteVector3(header_.extentsMin_);
+	written &= dest.WriteVector3(header_.extentsMax_);
+	written &= dest.WriteUInt(header_.fields_);
+	written &= dest.WriteDouble(origin_.x_);
+	written &= dest.WriteDouble(origin_.y_);
+	written &= dest.WriteDouble(origin_.z_);
+	written &= dest.WriteStringVector(layers_);
+
+	written &= WriteArray(dest, entities_);
+	written &= WriteArray(dest, vertices_);
+	written &= WriteArray(dest, indices_);
+	written &= WriteArray(dest, preciseVertices_);
+
+	written &= dest.WriteUInt(blocks_.Size());
+	for (unsigned i = 0; i < blocks_.Size(); ++i)
+	{
+		const DxfBlock& block = blocks_[i];
+		written &= dest.WriteString(block.name_);
+		written &= dest.WriteVector3(block.base_);
+		written &= dest.WriteUInt(block.fields_);
+		written &= dest.WriteBool(block.generic_);
+		written &= dest.WriteUInt(block.entityStart_);
+		written &= dest.WriteUInt(block.entityCount_);
+	}
+
+	written &= dest.WriteUInt(insertions_.Size());
+	for (unsigned i = 0; i < insertions_.Size(); ++i)
+	{
+		const DxfInsertion& insertion = insertions_[i];
+		written &= dest.WriteString(insertion.name_);
+		written &= dest.WriteVector3(insertion.position_);
+		written &= dest.WriteVector3(insertion.scale_);
+		written &= dest.WriteFloat(insertion.angle_);
+		written &= dest.WriteUInt(insertion.fields_);
+		written &= dest.WriteUInt(insertion.parent_);
+	}
+
+	written &= WriteArray(dest, instances_);
+	return written;
+}
+
+bool DxfDocument::Load(Deserializer& source)
+{
+	Clear();
+
+	header_.extentsMin_ = source.ReadVector3();
+	header_.extentsMax_ = source.ReadVector3();
+	header_.fields_ = source.ReadUInt();
+	origin_.x_ = source.ReadDouble();
+	origin_.y_ = source.ReadDouble();
+	origin_.z_ = source.ReadDouble();
+
+	//interned again to rebuild the lookup
+	Vector<String> layers = source.ReadStringVector();
+	for (unsigned i = 0; i < layers.Size(); ++i)
+		AddLayer(layers[i].CString(), layers[i].Length());
+
+	if (!ReadArray(source, entities_) || !ReadArray(source, vertices_) ||
+		!ReadArray(source, indices_) || !ReadArray(source, preciseVertices_))
+	{
+		Clear();
+		return false;
+	}
+
+	//every block and insertion takes more than a byte, so a count past the end is a broken snapshot
+	unsigned numBlocks = source.ReadUInt();
+	if (numBlocks > source.GetSize() - source.GetPosition())
+	{
+		Clear();
+		return false;
+	}
+
+	blocks_.Resize(numBlocks);
+	for (unsigned i = 0; i < blocks_.Size(); ++i)
+	{
+		DxfBlock& block = blocks_[i];
+		block.name_ = source.ReadString();
+		block.base_ = source.ReadVector3();
+		block.fields_ = source.ReadUInt();
+		block.generic_ = source.ReadBool();
+		block.entityStart_ = source.ReadUInt();
+		block.entityCount_ = source.ReadUInt();
+	}
+
+	unsigned numInsertions = source.ReadUInt();
+	if (numInsertions > source.GetSize() - source.GetPosition())
+	{
+		Clear();
+		return false;
+	}
+
+	insertions_.Resize(numInsertions);
+	for (unsigned i = 0; i < insertions_.Size(); ++i)
+	{
+		DxfInsertion& insertion = insertions_[i];
+		insertion.name_ = source.ReadString();
+		insertion.position_ = source.ReadVector3();
+		insertion.scale_ = source.ReadVector3();
+		insertion.angle_ = source.ReadFloat();
+		insertion.fields_ = source.ReadUInt();
+		insertion.parent_ = source.ReadUInt();
+	}
+
+	if (!ReadArray(source, instances_))
+	{
+		Clear();
+		return false;
+	}
+
+	return true;
+}
+
+VariantVector DxfDocument::ToVariantBlocks() const
+{
+	VariantVector blocks;
+
+	for (unsigned i = 0; i < blocks_.Size(); ++i)
+	{
+		const DxfBlock& source = blocks_[i];
+
+		VariantMap block;
+		block["000_TYPE"] = "BLOCK";
+
+		if (source.generic_)
+		{
+			block["Name"] = source.name_;
+			block["Insertions"] = VariantVector();
+			block["Lines"] = VariantVector();
+			blocks.Push(block);
+			continue;
+		}
+
+		block["Insertions"] = VariantVector();
+		block["Lines"] = VariantVector();
+
+		if (source.fields_ & DXF_BLOCK_NAME)
+			block["Name"] = source.name_;
+		if (source.fields_ & DXF_BLOCK_BASE_X)
+			block["Base_X"] = source.base_.x_;
+		if (source.fields_ & DXF_BLOCK_BASE_Y)
+			block["Base_Y"] = source.base_.y_;
+		if (source.fields_ & DXF_BLOCK_BASE_Z)
+			block["Base_Z"] = source.base_.z_;
+
+		blocks.Push(block);
+	}
+
+	return blocks;
+}
+
+VariantVector DxfDocument::ToVariantInsertions() const
+{
+	VariantVector insertions;
+
+	for (unsigned i = 0; i < insertions_.Size(); ++i)
+	{
+		const DxfInsertion& source = insertions_[i];
+
+		VariantMap insertion;
+		insertion["000_TYPE"] = "INSERTION";
+
+		if (source.fields_ & DXF_INSERT_NAME)
+			insertion["Name"] = source.name_;
+		if (source.fields_ & DXF_INSERT_POSITION_X)
+			insertion["Position_X"] = source.position_.x_;
+		if (source.fields_ & DXF_INSERT_POSITION_Y)
+			insertion["Position_Y"] = source.position_.y_;
+		if (source.fields_ & DXF_INSERT_POSITION_Z)
+			insertion["Position_Z"] = source.position_.z_;
+		if (source.fields_ & DXF_INSERT_SCALE_X)
+			insertion["Scale_X"] = source.scale_.x_;
+		if (source.fields_ & DXF_INSERT_SCALE_Y)
+			insertion["Scale_Y"] = source.scale_.y_;
+		if (source.fields_ & DXF_INSERT_SCALE_Z)
+			insertion["Scale_Z"] = source.scale_.z_;
+		if (source.fields_ & DXF_INSERT_ANGLE)
+			insertion["Angle"] = source.angle_;
+
+		insertions.Push(insertion);
+	}
+
+	return insertions;
+}
+
+VariantMap DxfDocument::ToVariantPolyline(const DxfEntity& entity) const
+{
+	VariantMap polyline;
+	polyline["000_TYPE"] = entity.type_ == DXF_3DFACE ? "3DFACE" : "POLYLINE";
+
+	VariantVector vertices;
+	vertices.Resize(entity.vertexCount_);
+	for (unsigned i = 0; i < entity.vertexCount_; ++i)
+		vertices[i] = vertices_[entity.vertexStart_ + i];
+	polyline["Vertices"] = vertices;
+
+	VariantVector faces;
+	faces.Resize(entity.indexCount_);
+	for (unsigned i = 0; i < entity.indexCount_; ++i)
+		faces[i] = indices_[entity.indexStart_ + i];
+	polyline["Faces"] = faces;
+
+	if (entity.layer_ != DXF_NO_LAYER)
+		polyline["Layer"] = layers_[entity.layer_];
+	if (entity.fields_ & DXF_FIELD_FLAGS)
+		polyline["Flags"] = entity.flags_;
+	if (entity.fields_ & DXF_FIELD_VERTICES_HINT)
+		polyline["NumVerticesHint"] = entity.verticesHint_;
+	if (entity.fields_ & DXF_FIELD_FACES_HINT)
+		polyline["NumFacesHint"] = entity.facesHint_;
+
+	return polyline;
+}
+
+VariantVector DxfDocument::ToVariantMeshes() const
+{
+	VariantVector meshes;
+
+	for (unsigned i = 0; i < entities_.Size(); ++i)
+	{
+		if (IsMesh(entities_[i]))
+			meshes.Push(ToVariantPolyline(entities_[i]));
+	}
+
+	return meshes;
+}
+
+VariantVector DxfDocument::ToVariantPolylines() const
+{
+	VariantVector polylines;
+
+	for (unsigned i = 0; i < entities_.Size(); ++i)
+	{
+		const DxfEntity& entity = entities_[i];
+		if (entity.type_ == DXF_3DFACE || (entity.type_ == DXF_POLYLINE && !IsMesh(entity)))
+			polylines.Push(ToVariantPolyline(entity));
+	}
+
+	return polylines;
+}
+
+VariantVector DxfDocument::ToVariantPoints() const
+{
+	VariantVector points;
+
+	for (unsigned i = 0; i < entities_.Size(); ++i)
+	{
+		const DxfEntity& entity = entities_[i];
+		if (entity.type_ != DXF_POINT)
+			continue;
+
+		VariantMap point;
+		point["000_TYPE"] = "POINT";
+		point["Position"] = vertices_[entity.vertexStart_];
+		point["Layer"] = entity.layer_ != DXF_NO_LAYER ? layers_[entity.layer_] : String("Default");
+
+		points.Push(point);
+	}
+
+	return points;
+}
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "Container/HashMap.h"
+#include "Container/RefCounted.h"
+#include "Container/Str.h"
+#include "Container/Vector.h"
+#include "Core/Variant.h"
+#include "Math/Matrix3x4.h"
+#include "Math/Vector3.h"
+#include "DxfEntityHandler.h"
+
+namespace Urho3D
+{
+	class Deserializer;
+	class Serializer;
+}
+
+using namespace Urho3D;
+
+//layer id of entities that did not specify one
+static const unsigned DXF_NO_LAYER = 0xffffffff;
+//block id of things that are not inside a BLOCK definition
+static const unsigned DXF_NO_BLOCK = 0xffffffff;
+//POLYLINE flag (group 70) of a polyface mesh
+static const unsigned DXF_POLYFACE_MESH = 64;
+
+//the entity types we keep
+enum DxfEntityType
+{
+	DXF_POINT = 0,
+	//POLYLINE and its VERTEX list. It is a polyface mesh if it carries face indices.
+	DXF_POLYLINE,
+	//3DFACE, LINE and 3DLINE. Always 4 corners.
+	DXF_3DFACE
+};
+
+//optional groups, flagged when they were present in the file
+enum DxfEntityField
+{
+	DXF_FIELD_FLAGS = 1 << 0,
+	DXF_FIELD_VERTICES_HINT = 1 << 1,
+	DXF_FIELD_FACES_HINT = 1 << 2,
+	//a 3DFACE with its third corner given. LINEs go through the same parser and have only two.
+	DXF_FIELD_THIRD_CORNER = 1 << 3
+};
+
+enum DxfBlockField
+{
+	DXF_BLOCK_NAME = 1 << 0,
+	DXF_BLOCK_BASE_X = 1 << 1,
+	DXF_BLOCK_BASE_Y = 1 << 2,
+	DXF_BLOCK_BASE_Z = 1 << 3
+};
+
+enum DxfHeaderField
+{
+	DXF_HEADER_EXTMIN = 1 << 0,
+	DXF_HEADER_EXTMAX = 1 << 1
+};
+
+enum DxfInsertionField
+{
+	DXF_INSERT_NAME = 1 << 0,
+	DXF_INSERT_POSITION_X = 1 << 1,
+	DXF_INSERT_POSITION_Y = 1 << 2,
+	DXF_INSERT_POSITION_Z = 1 << 3,
+	DXF_INSERT_SCALE_X = 1 << 4,
+	DXF_INSERT_SCALE_Y = 1 << 5,
+	DXF_INSERT_SCALE_Z = 1 << 6,
+	DXF_INSERT_ANGLE = 1 << 7
+};
+
+/**************************************************************************
+One parsed entity. The geometry itself lives in the document's shared
+arrays; an entity only records which range of them belongs to it:
+ ---- vertices [vertexStart_, vertexStart_ + vertexCount_)
+ ---- indices  [indexStart_, indexStart_ + indexCount_)
+
+Polyface meshes keep their indices as in the file: 1-based, negative for
+invisible edges, 3 or 4 per face record.
+***************************************************************************/
+struct DxfEntity
+{
+	DxfEntity(DxfEntityType type = DXF_POINT) :
+		type_((unsigned short)type),
+		fields_(0),
+		layer_(DXF_NO_LAYER),
+		flags_(0),
+		verticesHint_(0),
+		facesHint_(0),
+		vertexStart_(0),
+		vertexCount_(0),
+		indexStart_(0),
+		indexCount_(0)
+	{
+	}
+
+	//DxfEntityType. Both shorts so the struct has no padding.
+	unsigned short type_;
+	//DxfEntityField bits
+	unsigned short fields_;
+	//interned layer, DXF_NO_LAYER if none was given
+	unsigned layer_;
+	//code 70
+	unsigned flags_;
+	//codes 71 and 72 of a POLYLINE
+	unsigned verticesHint_;
+	unsigned facesHint_;
+
+	unsigned vertexStart_;
+	unsigned vertexCount_;
+	unsigned indexStart_;
+	unsigned indexCount_;
+};
+
+//a BLOCK definition, or the generic block that stands for the ENTITIES section
+struct DxfBlock
+{
+	DxfBlock() :
+		base_(Vector3::ZERO),
+		fields_(0),
+		generic_(false),
+		entityStart_(0),
+		entityCount_(0)
+	{
+	}
+
+	String name_;
+	Vector3 base_;
+	//DxfBlockField bits
+	unsigned fields_;
+	bool generic_;
+
+	//the entities of the definition, in block coordinates: [entityStart_, entityStart_ + entityCount_)
+	unsigned entityStart_;
+	unsigned entityCount_;
+};
+
+//the HEADER variables we read
+struct DxfHeader
+{
+	DxfHeader() :
+		extentsMin_(Vector3::ZERO),
+		extentsMax_(Vector3::ZERO),
+		fields_(0)
+	{
+	}
+
+	//$EXTMIN and $EXTMAX, the drawing extents in world coordinates
+	Vector3 extentsMin_;
+	Vector3 extentsMax_;
+	//DxfHeaderField bits
+	unsigned fields_;
+};
+
+//an INSERT reference to a block
+struct DxfInsertion
+{
+	DxfInsertion() :
+		position_(Vector3::ZERO),
+		scale_(Vector3::ONE),
+		angle_(0.0f),
+		fields_(0),
+		parent_(DXF_NO_BLOCK)
+	{
+	}
+
+	String name_;
+	Vector3 position_;
+	Vector3 scale_;
+	float angle_;
+	//DxfInsertionField bits
+	unsigned fields_;
+	//the block whose definition holds this INSERT, DXF_NO_BLOCK for the drawing itself
+	unsigned parent_;
+};
+
+//an INSERT resolved against its block. The block's geometry is stored once, however many instances there are.
+struct DxfInstance
+{
+	//index in the document's blocks
+	unsigned block_;
+	//the top-level INSERT this instance comes from; nested INSERTs yield several instances for one
+	unsigned insertion_;
+	//block coordinates to drawing coordinates: position * rotation about z * scale * -base point,
+	//composed along the chain of nested INSERTs
+	Matrix3x4 transform_;
+};
+
+/**************************************************************************
+Typed result of a parse, stored as flat arrays:
+ ---- one PODVector<DxfEntity> in file order
+ ---- one PODVector<Vector3> with the vertices of all entities
+ ---- one PODVector<int> with the face indices of all polyface meshes
+ ---- interned layer names
+ ---- with precise coordinates, a PODVector<DxfVector3d> parallel to the vertices
+
+Vertices are floats relative to the origin; the precise ones are not
+shifted. Entities inside BLOCK definitions keep their block coordinates.
+
+INSERTs are kept as read, and resolved into DxfInstances by
+ResolveInsertions(). INSERTs inside block definitions nest: each block
+is expanded once, children first, into a cached list of the blocks it
+places and their composed transforms, and every top-level INSERT then
+just multiplies its own transform onto that list. A block that ends up
+inserting itself is a cycle; the INSERT closing it is dropped. Flatten() copies the instanced geometry out when a
+consumer needs it that way.
+
+The document is the reader's default DxfEntityHandler: it keeps every
+entity it is handed.
+
+The ToVariant*() methods rebuild the old VariantMap-per-entity layout
+for code that still wants it. They copy everything on every call.
+***************************************************************************/
+class DxfDocument : public RefCounted, public DxfEntityHandler
+{
+public:
+	DxfDocument();
+
+	//building, used by the reader
+	void Clear();
+	//append the contents of another document, eg. one parsed from a later part of the same file
+	void Append(const DxfDocument& other);
+	unsigned AddLayer(const char* name, unsigned length);
+	//make room for this many more entities, vertices and indices
+	void Reserve(unsigned numEntities, unsigned numVertices, unsigned numIndices);
+	//copies the header of the entity, with empty vertex and index ranges at the end of the arrays.
+	//the returned reference is valid until the next entity is added
+	DxfEntity& AddEntity(const DxfEntity& header);
+	void AddVertex(DxfEntity& entity, const Vector3& vertex);
+	void AddIndex(DxfEntity& entity, int index);
+	DxfBlock& AddBlock() { blocks_.Resize(blocks_.Size() + 1); return blocks_.Back(); }
+	DxfInsertion& AddInsertion() { insertions_.Resize(insertions_.Size() + 1); return insertions_.Back(); }
+	//append an entity of another document with its vertices, indices and layer. Returns its index here.
+	unsigned CopyEntity(const DxfDocument& source, unsigned index);
+	DxfBlock& GetBlock(unsigned index) { return blocks_[index]; }
+	DxfHeader& GetHeader() { return header_; }
+
+	//DxfEntityHandler: keep everything
+	virtual void OnPoint(const DxfEntity& entity, const Vector3& position);
+	virtual void OnPolylineBegin(const DxfEntity& entity);
+	virtual void OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices);
+	virtual void OnPolylineEnd(const DxfEntity& entity);
+	virtual void On3DFace(const DxfEntity& entity, const Vector3* corners);
+	virtual void OnPrecisePositions(const DxfVector3d* positions, unsigned count);
+
+	//the world position of the float vertices' (0,0,0)
+	void SetOrigin(const DxfVector3d& origin) { origin_ = origin; }
+	const DxfVector3d& GetOrigin() const { return origin_; }
+
+	//typed access
+	const DxfHeader& GetHeader() const { return header_; }
+	const PODVector<DxfEntity>& GetEntities() const { return entities_; }
+	const PODVector<Vector3>& GetVertices() const { return vertices_; }
+	const PODVector<int>& GetIndices() const { return indices_; }
+	//empty unless the reader kept precise coordinates
+	const PODVector<DxfVector3d>& GetPreciseVertices() const { return preciseVertices_; }
+	//the precise vertex if there is one, otherwise the float vertex moved back by the origin.
+	//only meaningful for entities outside BLOCK definitions.
+	DxfVector3d GetWorldVertex(unsigned index) const;
+	const Vector<String>& GetLayers() const { return layers_; }
+	const String& GetLayerName(unsigned layer) const;
+	const Vector<DxfBlock>& GetBlocks() const { return blocks_; }
+	const Vector<DxfInsertion>& GetInsertions() const { return insertions_; }
+
+	//a POLYLINE is a mesh when it carries face indices
+	static bool IsMesh(const DxfEntity& entity) { return entity.type_ == DXF_POLYLINE && entity.indexCount_ > 3; }
+
+	//instancing. Resolving rebuilds the instances and returns how many INSERTs were dropped,
+	//because they name no block or close a cycle.
+	unsigned ResolveInsertions();
+	const PODVector<DxfInstance>& GetInstances() const { return instances_; }
+	//append a transformed copy of the block entities of every instance to another document
+	void Flatten(DxfDocument& dest) const;
+	//transform a range of positions with one matrix
+	static void TransformVertices(const Matrix3x4& transform, const Vector3* source, Vector3* dest, unsigned count);
+
+	//how often the entity, vertex or index array had to grow while being built
+	unsigned GetNumReallocations() const { return reallocations_; }
+
+	//approximate heap use of the typed arrays, in bytes
+	unsigned GetMemoryUse() const;
+
+	//binary snapshot of the whole document, see DxfCache.h. The flat arrays are written as
+	//they are in memory, so loading copies each one in a single read with nothing to decode.
+	//false if the destination took less than all of it
+	bool Save(Serializer& dest) const;
+	bool Load(Deserializer& source);
+
+	//compatibility views in the old VariantMap layout
+	VariantVector ToVariantBlocks() const;
+	VariantVector ToVariantInsertions() const;
+	VariantVector ToVariantMeshes() const;
+	VariantVector ToVariantPolylines() const;
+	VariantVector ToVariantPoints() const;
+
+protected:
+	VariantMap ToVariantPolyline(const DxfEntity& entity) const;
+	//placement of the block an INSERT names, in the coordinates the INSERT is in
+	Matrix3x4 GetInsertionTransform(unsigned insertion, unsigned block) const;
+
+	PODVector<DxfEntity> entities_;
+	PODVector<Vector3> vertices_;
+	PODVector<int> indices_;
+	PODVector<DxfVector3d> preciseVertices_;
+	DxfVector3d origin_;
+
+	//interned layer names; the id is the index in layers_
+	Vector<String> layers_;
+	HashMap<String, unsigned> layerIds_;
+	//entities tend to come in runs on the same layer, so remember the last one
+	unsigned lastLayer_;
+
+	//the polyline between OnPolylineBegin() and OnPolylineEnd()
+	unsigned currentPolyline_;
+	//growth of the arrays, see GetNumReallocations()
+	unsigned reallocations_;
+
+	DxfHeader header_;
+	Vector<DxfBlock> blocks_;
+	Vector<DxfInsertion> insertions_;
+	PODVector<DxfInstance> instances_;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Math/Vector3.h"
+#include "DxfVector3d.h"
+
+using namespace Urho3D;
+
+struct DxfEntity;
+
+/**************************************************************************
+Receives entities from the reader as they are parsed. The reader does not
+keep them, so a handler can stream a file of any size with bounded memory.
+
+The DxfEntity passed along carries the type, layer id, flags and hints.
+Its vertexStart_/indexStart_ are 0; vertexCount_/indexCount_ count what
+has been passed so far, and are final in OnPolylineEnd(). Layer ids can
+be resolved with the reader's document, which keeps the layer table.
+Only the drawing's own entities are streamed: the entities of BLOCK
+definitions stay in the document, where INSERTs are resolved into
+instances of them (see DxfDocument::GetInstances()).
+
+Positions are floats relative to the reader's origin (see
+DxfReader::SetOrigin()). With precise coordinates enabled, each call that
+carries positions is preceded by OnPrecisePositions() with the same
+positions in double precision, before the origin shift.
+
+Polylines arrive in three steps:
+ ---- OnPolylineBegin()   <- once the header groups are read
+ ---- OnPolylineVertex()  <- for each VERTEX; polyface face records carry 3 or 4 indices
+ ---- OnPolylineEnd()     <- at SEQEND
+***************************************************************************/
+class DxfEntityHandler
+{
+public:
+	virtual ~DxfEntityHandler() {}
+
+	//a POINT
+	virtual void OnPoint(const DxfEntity& entity, const Vector3& position) {}
+
+	//a POLYLINE and its VERTEX list
+	virtual void OnPolylineBegin(const DxfEntity& entity) {}
+	virtual void OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices) {}
+	virtual void OnPolylineEnd(const DxfEntity& entity) {}
+
+	//a 3DFACE, LINE or 3DLINE, always with 4 corners
+	virtual void On3DFace(const DxfEntity& entity, const Vector3* corners) {}
+
+	//precise coordinates only: the positions of the call that follows
+	virtual void OnPrecisePositions(const DxfVector3d* positions, unsigned count) {}
+};
@@ -0,0 +1,207 @@
+#include "DxfHandleIndex.h"
+
+namespace
+{
+	//smallest table
+	const unsigned MIN_TABLE_SIZE = 16;
+
+	inline unsigned HashHandle(unsigned long long handle, unsigned mask)
+	{
+		return (unsigned)((handle * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+	}
+
+	//where a handle is in an open addressing table of item number + 1, or the empty place it would go
+	template <class T> unsigned Probe(const PODVector<unsigned>& table, const PODVector<T>& items, unsigned long long handle)
+	{
+		unsigned mask = table.Size() - 1;
+		unsigned i = HashHandle(handle, mask);
+
+		while (table[i] && items[table[i] - 1].handle_ != handle)
+			i = (i + 1) & mask;
+
+		return i;
+	}
+
+	//power of two with room for count items at half load
+	unsigned TableSize(unsigned count)
+	{
+		unsigned size = MIN_TABLE_SIZE;
+		while (size < count * 2)
+			size <<= 1;
+		return size;
+	}
+}
+
+unsigned long long DxfParseHandle(const char* value, unsigned length)
+{
+	unsigned long long handle = 0;
+
+	//at most 16 hex digits
+	if (!length || length > 16)
+		return DXF_NO_HANDLE;
+
+	for (unsigned i = 0; i < length; ++i)
+	{
+		char c = value[i];
+		unsigned digit;
+
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else
+			return DXF_NO_HANDLE;
+
+		handle = (handle << 4) | digit;
+	}
+
+	return handle;
+}
+
+DxfHandleIndex::DxfHandleIndex() :
+	childrenValid_(false)
+{
+}
+
+void DxfHandleIndex::Clear()
+{
+	records_.Clear();
+	table_.Clear();
+	childrenValid_ = false;
+	children_.Clear();
+	owners_.Clear();
+	ownerTable_.Clear();
+}
+
+void DxfHandleIndex::Reserve(unsigned count)
+{
+	records_.Reserve(count);
+
+	if (TableSize(count) > table_.Size())
+		Rehash(TableSize(count));
+}
+
+void DxfHandleIndex::Rehash(unsigned capacity)
+{
+	table_.Resize(capacity);
+	for (unsigned i = 0; i < capacity; ++i)
+		table_[i] = 0;
+
+	for (unsigned i = 0; i < records_.Size(); ++i)
+		table_[Probe(table_, records_, records_[i].handle_)] = i + 1;
+}
+
+void DxfHandleIndex::Add(const DxfHandleRecord& record)
+{
+	if (record.handle_ == DXF_NO_HANDLE)
+		return;
+
+	childrenValid_ = false;
+
+	if ((records_.Size() + 1) * 2 > table_.Size())
+		Rehash(TableSize(records_.Size() + 1));
+
+	unsigned place = Probe(table_, records_, record.handle_);
+	if (table_[place])
+	{
+		records_[table_[place] - 1] = record;
+		return;
+	}
+
+	records_.Push(record);
+	table_[place] = records_.Size();
+}
+
+void DxfHandleIndex::Append(const DxfHandleIndex& other, unsigned slotOffset)
+{
+	Reserve(records_.Size() + other.records_.Size());
+
+	for (unsigned i = 0; i < other.records_.Size(); ++i)
+	{
+		DxfHandleRecord record = other.records_[i];
+		if (record.slot_ != DXF_NO_SLOT)
+			record.slot_ += slotOffset;
+		Add(record);
+	}
+}
+
+const DxfHandleRecord* DxfHandleIndex::Find(unsigned long long handle) const
+{
+	if (handle == DXF_NO_HANDLE || table_.Empty())
+		return 0;
+
+	unsigned place = Probe(table_, records_, handle);
+	return table_[place] ? &records_[table_[place] - 1] : 0;
+}
+
+void DxfHandleIndex::BuildChildren() const
+{
+	owners_.Clear();
+	ownerTable_.Resize(TableSize(records_.Size()));
+	for (unsigned i = 0; i < ownerTable_.Size(); ++i)
+		ownerTable_[i] = 0;
+
+	//count the children of each owner
+	for (unsigned i = 0; i < records_.Size(); ++i)
+	{
+		unsigned long long owner = records_[i].owner_;
+		if (owner == DXF_NO_HANDLE)
+			continue;
+
+		unsigned place = Probe(ownerTable_, owners_, owner);
+		if (!ownerTable_[place])
+		{
+			OwnerRange range;
+			range.handle_ = owner;
+			range.start_ = 0;
+			range.count_ = 0;
+			owners_.Push(range);
+			ownerTable_[place] = owners_.Size();
+		}
+
+		++owners_[ownerTable_[place] - 1].count_;
+	}
+
+	//then lay them out one owner after the other
+	unsigned start = 0;
+	for (unsigned i = 0; i < owners_.Size(); ++i)
+	{
+		owners_[i].start_ = start;
+		start += owners_[i].count_;
+		owners_[i].count_ = 0;
+	}
+
+	children_.Resize(start);
+	for (unsigned i = 0; i < records_.Size(); ++i)
+	{
+		unsigned long long owner = records_[i].owner_;
+		if (owner == DXF_NO_HANDLE)
+			continue;
+
+		OwnerRange& range = owners_[ownerTable_[Probe(ownerTable_, owners_, owner)] - 1];
+		children_[range.start_ + range.count_++] = i;
+	}
+
+	childrenValid_ = true;
+}
+
+unsigned DxfHandleIndex::GetChildren(unsigned long long owner, const unsigned*& children) const
+{
+	children = 0;
+
+	if (owner == DXF_NO_HANDLE || records_.Empty())
+		return 0;
+
+	if (!childrenValid_)
+		BuildChildren();
+
+	unsigned place = Probe(ownerTable_, owners_, owner);
+	if (!ownerTable_[place])
+		return 0;
+
+	const OwnerRange& range = owners_[ownerTable_[place] - 1];
+	children = range.count_ ? &children_[range.start_] : 0;
+	return range.count_;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Container/Str.h"
+#include "Container/Vector.h"
+#include "DxfTokenizer.h"
+
+using namespace Urho3D;
+
+//handle 0 is never given out, so it stands for none
+static const unsigned long long DXF_NO_HANDLE = 0;
+//an entity that is not in the document
+static const unsigned DXF_NO_SLOT = 0xffffffff;
+
+//the value of a handle (hex text, codes 5 and 330), DXF_NO_HANDLE if it is not one
+unsigned long long DxfParseHandle(const char* value, unsigned length);
+
+//where an entity with a handle ended up
+struct DxfHandleRecord
+{
+	unsigned long long handle_;
+	//code 330, DXF_NO_HANDLE if none was given
+	unsigned long long owner_;
+	//the entity in the document, DXF_NO_SLOT if it was not kept: INSERTs, streamed, filtered and culled entities
+	unsigned slot_;
+	//its 0 group in the file
+	DxfOffset offset_;
+};
+
+/**************************************************************************
+Handles of the parsed entities, for lookups in constant time:
+ ---- Find(handle)           <- the record of an entity
+ ---- GetOwner(record)       <- the record of its owner, if that was parsed
+ ---- GetChildren(owner)     <- the records that name an owner
+
+Records are kept in the order they were added. The lookup is an open
+addressing table of record numbers with linear probing, kept at most half
+full, so a record costs 32 bytes and the table 8 more at worst. Children
+are grouped by owner on the first GetChildren() after a change.
+***************************************************************************/
+class DxfHandleIndex
+{
+public:
+	DxfHandleIndex();
+
+	void Clear();
+	void Reserve(unsigned count);
+	//a later record of the same handle replaces the earlier one
+	void Add(const DxfHandleRecord& record);
+	//add the records of another index, with their slots moved by slotOffset
+	void Append(const DxfHandleIndex& other, unsigned slotOffset);
+
+	const DxfHandleRecord* Find(unsigned long long handle) const;
+	const DxfHandleRecord* Find(const String& handle) const { return Find(DxfParseHandle(handle.CString(), handle.Length())); }
+	const DxfHandleRecord* GetOwner(const DxfHandleRecord& record) const { return Find(record.owner_); }
+	//the records owned by a handle, as numbers into GetRecords(). Valid until the next Add().
+	unsigned GetChildren(unsigned long long owner, const unsigned*& children) const;
+
+	unsigned GetNumRecords() const { return records_.Size(); }
+	const PODVector<DxfHandleRecord>& GetRecords() const { return records_; }
+
+private:
+	//the children of one owner: [start_, start_ + count_) of children_
+	struct OwnerRange
+	{
+		unsigned long long handle_;
+		unsigned start_;
+		unsigned count_;
+	};
+
+	void Rehash(unsigned capacity);
+	void BuildChildren() const;
+
+	PODVector<DxfHandleRecord> records_;
+	//record number + 1, 0 for an empty place. The size is a power of two.
+	PODVector<unsigned> table_;
+
+	//children grouped by owner, with the owners found through ownerTable_ as records are through table_
+	mutable bool childrenValid_;
+	mutable PODVector<unsigned> children_;
+	mutable PODVector<OwnerRange> owners_;
+	mutable PODVector<unsigned> ownerTable_;
+};
@@ -0,0 +1,384 @@
+#include "DxfMeshExporter.h"
+
+#include "Core/WorkQueue.h"
+#include "Math/MathDefs.h"
+
+#include <cstring>
+
+namespace
+{
+	const unsigned NO_BUFFER = 0xffffffff;
+	const unsigned NO_VERTEX = 0xffffffff;
+
+	//vertices per weld work item
+	const unsigned WELD_BATCH = 1 << 16;
+
+	struct WeldCell
+	{
+		int x_;
+		int y_;
+		int z_;
+	};
+
+	//the grid of one buffer, shared by the weld work items
+	struct WeldGrid
+	{
+		const float* positions_;
+		float epsilon_;
+		float invCellSize_;
+		unsigned mask_;
+		//first vertex of each bucket, then the next one in the same bucket
+		PODVector<unsigned> heads_;
+		PODVector<unsigned> next_;
+		//cell of each vertex
+		PODVector<WeldCell> cells_;
+		//first vertex within epsilon of each vertex, the vertex itself if none comes before
+		PODVector<unsigned> targets_;
+	};
+
+	inline unsigned HashCell(int x, int y, int z, unsigned mask)
+	{
+		return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u) & mask;
+	}
+
+	void FindWeldTargets(WeldGrid& grid, unsigned start, unsigned end)
+	{
+		const float epsilonSquared = grid.epsilon_ * grid.epsilon_;
+
+		for (unsigned i = start; i < end; ++i)
+		{
+			const float* p = grid.positions_ + i * 3;
+			const WeldCell& cell = grid.cells_[i];
+			unsigned target = i;
+
+			for (int z = cell.z_ - 1; z <= cell.z_ + 1; ++z)
+			{
+				for (int y = cell.y_ - 1; y <= cell.y_ + 1; ++y)
+				{
+					for (int x = cell.x_ - 1; x <= cell.x_ + 1; ++x)
+					{
+						//buckets hold other cells too; the distance sorts them out
+						for (unsigned j = grid.heads_[HashCell(x, y, z, grid.mask_)]; j != NO_VERTEX; j = grid.next_[j])
+						{
+							if (j >= target)
+								continue;
+
+							const float* q = grid.positions_ + j * 3;
+							float dx = p[0] - q[0];
+							float dy = p[1] - q[1];
+							float dz = p[2] - q[2];
+							if (dx * dx + dy * dy + dz * dz <= epsilonSquared)
+								target = j;
+						}
+					}
+				}
+			}
+
+			grid.targets_[i] = target;
+		}
+	}
+
+	void FindWeldTargetsWork(const WorkItem* item, unsigned threadIndex)
+	{
+		WeldGrid& grid = *reinterpret_cast<WeldGrid*>(item->aux_);
+		unsigned start = (unsigned)(size_t)item->start_;
+		unsigned end = (unsigned)(size_t)item->end_;
+		FindWeldTargets(grid, start, end);
+	}
+}
+
+DxfMeshExporter::DxfMeshExporter(DxfVertexLayout layout) :
+	layout_(layout),
+	currentBuffer_(NO_BUFFER),
+	meshStart_(0),
+	meshVertices_(0),
+	invalidFaces_(0),
+	weldedFaces_(0),
+	weldEpsilon_(0.0f),
+	weldQueue_(0),
+	inputVertices_(0),
+	outputVertices_(0)
+{
+}
+
+void DxfMeshExporter::SetWeld(float epsilon, WorkQueue* queue)
+{
+	weldEpsilon_ = Max(epsilon, 0.0f);
+	weldQueue_ = queue;
+}
+
+float DxfMeshExporter::GetWeldRatio() const
+{
+	return inputVertices_ ? (float)outputVertices_ / (float)inputVertices_ : 1.0f;
+}
+
+unsigned DxfMeshExporter::GetBuffer(unsigned layer)
+{
+	HashMap<unsigned, unsigned>::ConstIterator i = layerBuffers_.Find(layer);
+	if (i != layerBuffers_.End())
+		return i->second_;
+
+	unsigned buffer = buffers_.Size();
+	layerBuffers_[layer] = buffer;
+	buffers_.Resize(buffers_.Size() + 1);
+	buffers_.Back().layer_ = layer;
+	indices_.Resize(indices_.Size() + 1);
+	return buffer;
+}
+
+void DxfMeshExporter::OnPolylineBegin(const DxfEntity& entity)
+{
+	currentBuffer_ = NO_BUFFER;
+
+	if (!(entity.flags_ & DXF_POLYFACE_MESH))
+		return;
+
+	currentBuffer_ = GetBuffer(entity.layer_);
+
+	DxfMeshBuffer& buffer = buffers_[currentBuffer_];
+	meshStart_ = buffer.vertexCount_;
+	meshVertices_ = 0;
+
+	//the hints count vertex and face records
+	if (entity.fields_ & DXF_FIELD_VERTICES_HINT)
+		buffer.vertexData_.Reserve(buffer.vertexData_.Size() + 3 * Min(entity.verticesHint_, 1u << 24));
+}
+
+void DxfMeshExporter::OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices)
+{
+	if (currentBuffer_ == NO_BUFFER)
+		return;
+
+	//face records have a position too, but it means nothing
+	if (numIndices)
+	{
+		AddFace(indices, numIndices);
+		return;
+	}
+
+	DxfMeshBuffer& buffer = buffers_[currentBuffer_];
+	buffer.vertexData_.Push(position.x_);
+	buffer.vertexData_.Push(position.y_);
+	buffer.vertexData_.Push(position.z_);
+	++buffer.vertexCount_;
+	++meshVertices_;
+}
+
+void DxfMeshExporter::OnPolylineEnd(const DxfEntity& entity)
+{
+	currentBuffer_ = NO_BUFFER;
+}
+
+void DxfMeshExporter::On3DFace(const DxfEntity& entity, const Vector3* corners)
+{
+	if (!(entity.fields_ & DXF_FIELD_THIRD_CORNER))
+		return;
+
+	unsigned index = GetBuffer(entity.layer_);
+	DxfMeshBuffer& buffer = buffers_[index];
+
+	//the fourth corner repeats the third on triangles
+	unsigned numCorners = corners[3].Equals(corners[2]) ? 3 : 4;
+	unsigned start = buffer.vertexCount_;
+
+	for (unsigned i = 0; i < numCorners; ++i)
+	{
+		buffer.vertexData_.Push(corners[i].x_);
+		buffer.vertexData_.Push(corners[i].y_);
+		buffer.vertexData_.Push(corners[i].z_);
+	}
+	buffer.vertexCount_ += numCorners;
+
+	PODVector<unsigned>& triangles = indices_[index];
+	triangles.Push(start);
+	triangles.Push(start + 1);
+	triangles.Push(start + 2);
+
+	if (numCorners == 4)
+	{
+		triangles.Push(start);
+		triangles.Push(start + 2);
+		triangles.Push(start + 3);
+	}
+}
+
+void DxfMeshExporter::AddFace(const int* indices, unsigned numIndices)
+{
+	//a fourth index of 0 means a triangle
+	if (numIndices == 4 && !indices[3])
+		numIndices = 3;
+
+	if (numIndices < 3)
+	{
+		++invalidFaces_;
+		return;
+	}
+
+	unsigned corners[4];
+	for (unsigned i = 0; i < numIndices; ++i)
+	{
+		unsigned index = (unsigned)Abs(indices[i]);
+		if (!index || index > meshVertices_)
+		{
+			++invalidFaces_;
+			return;
+		}
+		corners[i] = meshStart_ + index - 1;
+	}
+
+	PODVector<unsigned>& triangles = indices_[currentBuffer_];
+	triangles.Push(corners[0]);
+	triangles.Push(corners[1]);
+	triangles.Push(corners[2]);
+
+	if (numIndices == 4 && corners[3] != corners[2])
+	{
+		triangles.Push(corners[0]);
+		triangles.Push(corners[2]);
+		triangles.Push(corners[3]);
+	}
+}
+
+void DxfMeshExporter::Weld(DxfMeshBuffer& buffer, PODVector<unsigned>& triangles)
+{
+	unsigned count = buffer.vertexCount_;
+	if (count < 2)
+		return;
+
+	WeldGrid grid;
+	grid.positions_ = buffer.vertexData_.Buffer();
+	grid.epsilon_ = weldEpsilon_;
+	grid.invCellSize_ = 1.0f / weldEpsilon_;
+
+	//about one bucket per vertex
+	unsigned buckets = NextPowerOfTwo(count);
+	grid.mask_ = buckets - 1;
+	grid.heads_.Resize(buckets);
+	grid.next_.Resize(count);
+	grid.cells_.Resize(count);
+	grid.targets_.Resize(count);
+
+	for (unsigned i = 0; i < buckets; ++i)
+		grid.heads_[i] = NO_VERTEX;
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const float* p = grid.positions_ + i * 3;
+		WeldCell& cell = grid.cells_[i];
+		cell.x_ = FloorToInt(p[0] * grid.invCellSize_);
+		cell.y_ = FloorToInt(p[1] * grid.invCellSize_);
+		cell.z_ = FloorToInt(p[2] * grid.invCellSize_);
+
+		unsigned bucket = HashCell(cell.x_, cell.y_, cell.z_, grid.mask_);
+		grid.next_[i] = grid.heads_[bucket];
+		grid.heads_[bucket] = i;
+	}
+
+	//the lookups only read the grid, so they split freely
+	if (weldQueue_ && count > WELD_BATCH)
+	{
+		for (unsigned start = 0; start < count; start += WELD_BATCH)
+		{
+			SharedPtr<WorkItem> item = weldQueue_->GetFreeItem();
+			item->priority_ = M_MAX_UNSIGNED;
+			item->workFunction_ = FindWeldTargetsWork;
+			item->start_ = (void*)(size_t)start;
+			item->end_ = (void*)(size_t)Min(start + WELD_BATCH, count);
+			item->aux_ = &grid;
+			weldQueue_->AddWorkItem(item);
+		}
+
+		weldQueue_->Complete(M_MAX_UNSIGNED);
+	}
+	else
+		FindWeldTargets(grid, 0, count);
+
+	//targets come before their vertices, so one pass in order follows every chain to its first vertex.
+	//the kept vertices move down in place.
+	PODVector<unsigned>& remap = grid.next_;
+	float* positions = buffer.vertexData_.Buffer();
+	unsigned kept = 0;
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned target = grid.targets_[i];
+		if (target == i)
+		{
+			if (kept != i)
+				memcpy(positions + kept * 3, positions + i * 3, 3 * sizeof(float));
+			remap[i] = kept++;
+		}
+		else
+			remap[i] = remap[target];
+	}
+
+	//a triangle with two corners in one cluster has no area left, so it is dropped
+	unsigned numIndices = 0;
+	for (unsigned i = 0; i + 2 < triangles.Size(); i += 3)
+	{
+		unsigned a = remap[triangles[i]];
+		unsigned b = remap[triangles[i + 1]];
+		unsigned c = remap[triangles[i + 2]];
+
+		if (a == b || b == c || a == c)
+		{
+			++weldedFaces_;
+			continue;
+		}
+
+		triangles[numIndices++] = a;
+		triangles[numIndices++] = b;
+		triangles[numIndices++] = c;
+	}
+	triangles.Resize(numIndices);
+
+	buffer.vertexCount_ = kept;
+	buffer.vertexData_.Resize(kept * 3);
+}
+
+void DxfMeshExporter::Finish()
+{
+	for (unsigned i = 0; i < buffers_.Size(); ++i)
+	{
+		DxfMeshBuffer& buffer = buffers_[i];
+		PODVector<unsigned>& triangles = indices_[i];
+
+		inputVertices_ += buffer.vertexCount_;
+		if (weldEpsilon_ > 0.0f)
+			Weld(buffer, triangles);
+		outputVertices_ += buffer.vertexCount_;
+
+		if (layout_ == DXF_LAYOUT_PLANAR)
+		{
+			PODVector<float> planar(buffer.vertexData_.Size());
+			for (unsigned j = 0; j < buffer.vertexCount_; ++j)
+			{
+				planar[j] = buffer.vertexData_[j * 3];
+				planar[buffer.vertexCount_ + j] = buffer.vertexData_[j * 3 + 1];
+				planar[buffer.vertexCount_ * 2 + j] = buffer.vertexData_[j * 3 + 2];
+			}
+			buffer.vertexData_ = planar;
+		}
+
+		buffer.indexCount_ = triangles.Size();
+
+		if (buffer.vertexCount_ <= 0xffff)
+		{
+			buffer.indexSize_ = sizeof(unsigned short);
+			buffer.indexData_.Resize(triangles.Size() * sizeof(unsigned short));
+			unsigned short* dest = reinterpret_cast<unsigned short*>(buffer.indexData_.Buffer());
+			for (unsigned j = 0; j < triangles.Size(); ++j)
+				dest[j] = (unsigned short)triangles[j];
+		}
+		else
+		{
+			buffer.indexSize_ = sizeof(unsigned);
+			buffer.indexData_.Resize(triangles.Size() * sizeof(unsigned));
+			if (triangles.Size())
+				memcpy(buffer.indexData_.Buffer(), triangles.Buffer(), triangles.Size() * sizeof(unsigned));
+		}
+	}
+
+	indices_.Clear();
+	indices_.Resize(buffers_.Size());
+}
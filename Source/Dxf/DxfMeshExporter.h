@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Container/HashMap.h"
+#include "Container/Vector.h"
+#include "DxfDocument.h"
+#include "DxfEntityHandler.h"
+
+namespace Urho3D
+{
+	class WorkQueue;
+}
+
+using namespace Urho3D;
+
+//how the positions of a DxfMeshBuffer are laid out
+enum DxfVertexLayout
+{
+	//x0 y0 z0 x1 y1 z1 ...
+	DXF_LAYOUT_INTERLEAVED = 0,
+	//x0 x1 ... y0 y1 ... z0 z1 ...
+	DXF_LAYOUT_PLANAR
+};
+
+//the triangles of one layer, ready to upload as a vertex and an index buffer
+struct DxfMeshBuffer
+{
+	DxfMeshBuffer() :
+		layer_(DXF_NO_LAYER),
+		vertexCount_(0),
+		indexSize_(sizeof(unsigned)),
+		indexCount_(0)
+	{
+	}
+
+	//layer id in the reader's document
+	unsigned layer_;
+	//3 floats per vertex, in the exporter's layout
+	PODVector<float> vertexData_;
+	unsigned vertexCount_;
+	//triangle list, 16-bit indices when the vertices allow, otherwise 32-bit
+	PODVector<unsigned char> indexData_;
+	unsigned indexSize_;
+	unsigned indexCount_;
+};
+
+/**************************************************************************
+Turns polyface meshes (POLYLINEs with flag 64) and 3DFACEs into triangle
+buffers split by layer. It is an entity handler, so it can take the entities straight
+from the reader without a document in between:
+ ---- reader->SetEntityHandler(&exporter);
+ ---- reader->Parse();
+ ---- exporter.Finish();
+The document keeps the indices of all faces in one run, so the face
+records have to come from the reader.
+
+Face records carry 1-based indices into the vertex records of their mesh;
+negative ones mark invisible edges and are made positive. A face with a
+fourth index is split into two triangles. Faces with an index of 0 or
+past the mesh's vertices are dropped and counted.
+
+3DFACEs bring their own corners, so a tessellated surface repeats each
+position in every face around it. SetWeld() merges vertices closer than
+an epsilon in Finish(): a spatial hash grid with cells of epsilon size
+finds the candidates in the 27 cells around each vertex, in near-linear
+time. Each vertex goes to the first one of its cluster. The lookups run on
+the WorkQueue when one is given. Triangles left with two corners in one
+cluster are dropped and counted.
+***************************************************************************/
+class DxfMeshExporter : public DxfEntityHandler
+{
+public:
+	DxfMeshExporter(DxfVertexLayout layout = DXF_LAYOUT_INTERLEAVED);
+
+	//DxfEntityHandler: meshes only
+	virtual void OnPolylineBegin(const DxfEntity& entity);
+	virtual void OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices);
+	virtual void OnPolylineEnd(const DxfEntity& entity);
+	virtual void On3DFace(const DxfEntity& entity, const Vector3* corners);
+
+	//merge vertices closer than epsilon in Finish(), 0 to keep them all
+	void SetWeld(float epsilon, WorkQueue* queue = 0);
+
+	//lay the vertices out and pick the index size. Call once, after the last entity.
+	void Finish();
+
+	const Vector<DxfMeshBuffer>& GetBuffers() const { return buffers_; }
+	unsigned GetNumInvalidFaces() const { return invalidFaces_; }
+	//triangles the weld collapsed
+	unsigned GetNumWeldedFaces() const { return weldedFaces_; }
+	//vertices after Finish() over vertices before, 1 without welding
+	float GetWeldRatio() const;
+
+protected:
+	unsigned GetBuffer(unsigned layer);
+	void AddFace(const int* indices, unsigned numIndices);
+	void Weld(DxfMeshBuffer& buffer, PODVector<unsigned>& triangles);
+
+	DxfVertexLayout layout_;
+	Vector<DxfMeshBuffer> buffers_;
+	//buffer index by layer id
+	HashMap<unsigned, unsigned> layerBuffers_;
+	//32-bit triangle indices of each buffer, until Finish()
+	Vector<PODVector<unsigned> > indices_;
+
+	//the mesh being read: its buffer, and where its vertices start in it. No buffer outside a mesh.
+	unsigned currentBuffer_;
+	unsigned meshStart_;
+	unsigned meshVertices_;
+
+	unsigned invalidFaces_;
+	unsigned weldedFaces_;
+
+	float weldEpsilon_;
+	WorkQueue* weldQueue_;
+	unsigned inputVertices_;
+	unsigned outputVertices_;
+};
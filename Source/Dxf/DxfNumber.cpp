@@ -0,0 +1,187 @@
+#include "DxfNumber.h"
+
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	//longest text handed to the strtod fallback
+	const unsigned MAX_FALLBACK_LENGTH = 127;
+
+	//powers of ten that are exact in a double
+	const double EXACT_POWERS[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int MAX_EXACT_POWER = 22;
+
+	//largest integer a double holds exactly
+	const unsigned long long MAX_EXACT_MANTISSA = 1ull << 53;
+
+	inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	//strtod on a terminated copy, with the decimal point the C locale expects
+	double Fallback(const char* value, unsigned length)
+	{
+		char buffer[MAX_FALLBACK_LENGTH + 1];
+		if (length > MAX_FALLBACK_LENGTH)
+			length = MAX_FALLBACK_LENGTH;
+		memcpy(buffer, value, length);
+		buffer[length] = 0;
+
+		char point = *localeconv()->decimal_point;
+		if (point != '.')
+		{
+			char* dot = strchr(buffer, '.');
+			if (dot)
+				*dot = point;
+		}
+
+		return strtod(buffer, 0);
+	}
+
+	//sign and digits of an integer, saturated to the range of a long long
+	long long ParseInteger(const char* value, unsigned length)
+	{
+		const char* c = value;
+		const char* end = value + length;
+
+		bool negative = false;
+		if (c < end && (*c == '-' || *c == '+'))
+		{
+			negative = *c == '-';
+			++c;
+		}
+
+		unsigned long long result = 0;
+		while (c < end && IsDigit(*c))
+		{
+			if (result < 1000000000000000000ull)
+				result = result * 10 + (unsigned)(*c - '0');
+			++c;
+		}
+
+		return negative ? -(long long)result : (long long)result;
+	}
+}
+
+double DxfToDouble(const char* value, unsigned length)
+{
+	const char* c = value;
+	const char* end = value + length;
+
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		negative = *c == '-';
+		++c;
+	}
+
+	//gather up to 19 significant digits; the decimal point moves the exponent
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	unsigned numDigits = 0;
+	bool truncated = false;
+	bool anyDigits = false;
+
+	for (; c < end && IsDigit(*c); ++c)
+	{
+		anyDigits = true;
+		if (numDigits < 19)
+		{
+			mantissa = mantissa * 10 + (unsigned)(*c - '0');
+			if (mantissa)
+				++numDigits;
+		}
+		else
+		{
+			++exponent;
+			truncated |= *c != '0';
+		}
+	}
+
+	if (c < end && *c == '.')
+	{
+		for (++c; c < end && IsDigit(*c); ++c)
+		{
+			anyDigits = true;
+			if (numDigits < 19)
+			{
+				mantissa = mantissa * 10 + (unsigned)(*c - '0');
+				if (mantissa)
+					++numDigits;
+				--exponent;
+			}
+			else
+				truncated |= *c != '0';
+		}
+	}
+
+	//inf, nan and garbage
+	if (!anyDigits)
+		return Fallback(value, length);
+
+	if (c < end && (*c == 'e' || *c == 'E'))
+	{
+		const char* e = c + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+'))
+		{
+			negativeExponent = *e == '-';
+			++e;
+		}
+
+		//"1e" is just 1, like strtod reads it
+		if (e < end && IsDigit(*e))
+		{
+			int written = 0;
+			for (; e < end && IsDigit(*e); ++e)
+			{
+				if (written < 100000)
+					written = written * 10 + (*e - '0');
+			}
+			exponent += negativeExponent ? -written : written;
+		}
+	}
+
+	if (!mantissa)
+		return negative ? -0.0 : 0.0;
+
+	//exact: both the mantissa and the power of ten are doubles without rounding, so one operation rounds correctly
+	if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER)
+	{
+		double result = (double)mantissa;
+		if (exponent < 0)
+			result /= EXACT_POWERS[-exponent];
+		else
+			result *= EXACT_POWERS[exponent];
+
+		return negative ? -result : result;
+	}
+
+	return Fallback(value, length);
+}
+
+int DxfToInt(const char* value, unsigned length)
+{
+	long long result = ParseInteger(value, length);
+
+	//strtol saturates too
+	if (result > 0x7fffffffll)
+		return 0x7fffffff;
+	if (result < -0x80000000ll)
+		return (int)-0x80000000ll;
+
+	return (int)result;
+}
+
+unsigned DxfToUInt(const char* value, unsigned length)
+{
+	//strtoul wraps negative values around
+	return (unsigned)ParseInteger(value, length);
+}
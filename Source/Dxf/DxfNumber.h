@@ -0,0 +1,18 @@
+#pragma once
+
+/**************************************************************************
+Number parsing for dxf values. These work on the raw characters of a
+group, need no terminator or allocation, and ignore the C locale, which
+could otherwise turn "1.5" into 1.
+
+Doubles take the exact fast path when the digits fit in 53 bits and the
+power of ten is small, which covers the usual coordinates. Anything else
+(long mantissas, huge exponents, inf, nan) falls back to strtod, so the
+result is always the same as strtod in the "C" locale.
+
+Like strtod and strtol they read the longest valid prefix and return 0
+if there is none.
+***************************************************************************/
+double DxfToDouble(const char* value, unsigned length);
+int DxfToInt(const char* value, unsigned length);
+unsigned DxfToUInt(const char* value, unsigned length);
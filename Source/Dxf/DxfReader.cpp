@@ -1,362 +1,1504 @@
 #include "DxfReader.h"
+#include "DxfCompression.h"
 #include "Core/StringUtils.h"
+#include "Core/ProcessUtils.h"
+#include "Core/Thread.h"
+#include "IO/File.h"
 #include "IO/Log.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//both levels are tested before the message is built; below DXF_LOG_LEVEL the call compiles away.
+//chunk readers run on worker threads, whose log messages are only flushed on frame events we never send.
+#ifdef URHO3D_LOGGING
+#define DXF_LOG(level, message) do { if (level >= DXF_LOG_LEVEL && level >= logLevel_) Urho3D::Log::Write(level, message); } while (false)
+#else
+#define DXF_LOG(level, message) ((void)0)
+#endif
+#define DXF_LOGDEBUG(message) DXF_LOG(Urho3D::LOG_DEBUG, message)
+#define DXF_LOGINFO(message) DXF_LOG(Urho3D::LOG_INFO, message)
+#define DXF_LOGWARNING(message) DXF_LOG(Urho3D::LOG_WARNING, message)
+
 namespace
 {
-	int currLineNumber = 0;
-	LinePair nextPair;
-	File* source_;
+	void ParseEntityChunkWork(const WorkItem* item, unsigned threadIndex)
+	{
+		DxfReader* chunk = reinterpret_cast<DxfReader*>(item->start_);
+		chunk->ParseEntityChunk();
+	}
+
+	//what each DxfWarning reports
+	const char* warningMessages[] =
+	{
+		"vertex colors ignored",
+		"face records with more than 4 indices truncated"
+	};
+
+	//the built-in entity parsers
+	void ParsePolyLineEntity(DxfReader& reader) { reader.ParsePolyLine(); }
+	void ParseInsertionEntity(DxfReader& reader) { reader.ParseInsertion(); }
+	void ParsePointEntity(DxfReader& reader) { reader.ParsePoint(); }
+	void Parse3DFaceEntity(DxfReader& reader) { reader.Parse3DFace(); }
+}
+
+
+DxfReader::DxfReader(Context* context, String path) : DxfReader(context, DxfTokenizer(), 0, DXF_NO_OFFSET)
+{
+	path_ = path;
+	logLevel_ = LOG_INFO;
+
+	//map the file. Compressed ones are expanded on the WorkQueue, which is only created for them.
+	WorkQueue* queue = Thread::IsMainThread() && IsDxfCompressedFile(context, path) ? GetWorkQueue() : 0;
+	bool res = tokenizer_.Open(path, queue);
+
+	//make sure that this file exists
+	assert(res);
+
+	//create the log, unless there is one already
+	if (!GetSubsystem<Log>()) {
+		GetContext()->RegisterSubsystem(new Log(GetContext()));
+	}
+
+	RegisterDefaultEntityParsers();
+
+	if (!res) {
+		URHO3D_LOGERROR("DXF: could not open " + path);
+	}
+}
+
+DxfReader::DxfReader(Context* context, const char* data, DxfOffset size) : DxfReader(context, DxfTokenizer(), 0, DXF_NO_OFFSET)
+{
+	logLevel_ = LOG_INFO;
+
+	if (IsDxfCompressed(data, size)) {
+		tokenizer_.SetCompressedBuffer(data, size, Thread::IsMainThread() ? GetWorkQueue() : 0);
+	}
+	else {
+		tokenizer_.SetBuffer(data, size);
+	}
+
+	//create the log, unless there is one already
+	if (!GetSubsystem<Log>()) {
+		GetContext()->RegisterSubsystem(new Log(GetContext()));
+	}
+
+	RegisterDefaultEntityParsers();
+}
+
+DxfReader::DxfReader(Context* context, const DxfTokenizer& tokenizer, DxfOffset start, DxfOffset end) : Object(context),
+	tokenizer_(tokenizer),
+	groupPosition_(start),
+	parallel_(false),
+	chunkSize_(DXF_DEFAULT_CHUNK_SIZE),
+	chunkStart_(start),
+	chunkEnd_(end),
+	logLevel_(LOG_NONE),
+	precount_(false),
+	precise_(false),
+	autoOrigin_(false),
+	originResolved_(false),
+	currentBlock_(DXF_NO_BLOCK),
+	layerFilter_(false),
+	filterInclude_(true),
+	layerPredicate_(0),
+	layerPredicateData_(0),
+	filteredEntities_(0),
+	filteredBytes_(0),
+	typeFilter_(false),
+	polyfaceOnly_(false),
+	recordBounds_(false),
+	culledEntities_(0),
+	entitiesEnd_(DXF_NO_OFFSET),
+	boundsLoaded_(false),
+	cacheCompress_(false),
+	fromCache_(false),
+	handleIndex_(false),
+	entityHandle_(DXF_NO_HANDLE),
+	entityOwner_(DXF_NO_HANDLE),
+	indexPosition_(0),
+	indexSection_(M_MAX_UNSIGNED),
+	indexInPolyline_(false),
+	indexComplete_(false),
+	customParsers_(false),
+	document_(new DxfDocument()),
+	handler_(document_.Get())
+{
+	memset(warnings_, 0, sizeof warnings_);
+}
+
+void DxfReader::RegisterDefaultEntityParsers()
+{
+	RegisterEntityParser("POLYLINE", ParsePolyLineEntity);
+	RegisterEntityParser("INSERT", ParseInsertionEntity);
+	RegisterEntityParser("POINT", ParsePointEntity);
+
+	//http://sourceforge.net/tracker/index.php?func=detail&aid=2970566&group_id=226462&atid=1067632
+	RegisterEntityParser("3DFACE", Parse3DFaceEntity);
+	RegisterEntityParser("LINE", Parse3DFaceEntity);
+	RegisterEntityParser("3DLINE", Parse3DFaceEntity);
+
+	customParsers_ = false;
+}
+
+void DxfReader::RegisterEntityParser(const String& name, DxfEntityParser parser)
+{
+	StringHash hash = DxfHash(name.CString(), name.Length());
+	customParsers_ = true;
+
+	if (!parser) {
+		entityParsers_.Erase(hash);
+		return;
+	}
+
+	DxfEntityParserEntry& entry = entityParsers_[hash];
+	entry.name_ = name;
+	entry.parser_ = parser;
+}
+
+DxfEntityParser DxfReader::GetEntityParser(const DxfGroup& group) const
+{
+	HashMap<StringHash, DxfEntityParserEntry>::ConstIterator i = entityParsers_.Find(group.GetHash());
+
+	if (i == entityParsers_.End() || !group.Equals(i->second_.name_.CString())) {
+		return 0;
+	}
+
+	return i->second_.parser_;
+}
+
+void DxfReader::SetOrigin(const DxfVector3d& origin)
+{
+	origin_ = origin;
+	originResolved_ = true;
+	autoOrigin_ = false;
+	document_->SetOrigin(origin_);
+}
+
+void DxfReader::ResolveAutoOrigin(const DxfVector3d& fallback)
+{
+	const DxfHeader& header = document_->GetHeader();
+
+	DxfVector3d start = fallback;
+	if (header.fields_ & DXF_HEADER_EXTMIN) {
+		start = DxfVector3d(header.extentsMin_.x_, header.extentsMin_.y_, header.extentsMin_.z_);
+	}
+
+	//whole units, so the local coordinates read the same as the file's
+	SetOrigin(DxfVector3d(floor(start.x_), floor(start.y_), floor(start.z_)));
+}
+
+void DxfReader::Localize(const DxfVector3d* positions, Vector3* local, unsigned count)
+{
+	if (precise_) {
+		handler_->OnPrecisePositions(positions, count);
+	}
+
+	Shift(positions, local, count);
+}
+
+void DxfReader::Shift(const DxfVector3d* positions, Vector3* local, unsigned count)
+{
+	if (currentBlock_ != DXF_NO_BLOCK) {
+		for (unsigned i = 0; i < count; ++i) {
+			local[i] = positions[i].ToVector3();
+		}
+		return;
+	}
+
+	if (autoOrigin_ && !originResolved_) {
+		ResolveAutoOrigin(positions[0]);
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		local[i] = (positions[i] - origin_).ToVector3();
+	}
+}
+
+void DxfReader::SetEntityHandler(DxfEntityHandler* handler)
+{
+	handler_ = handler ? handler : document_.Get();
+}
+
+void DxfReader::SetParallel(bool enable, unsigned chunkSize)
+{
+	parallel_ = enable;
+	chunkSize_ = chunkSize;
+}
+
+void DxfReader::SetLayerFilter(const Vector<String>& layers, bool include)
+{
+	ClearLayerFilter();
+
+	for (unsigned i = 0; i < layers.Size(); ++i) {
+		filterLayers_.Insert(layers[i]);
+	}
+
+	filterInclude_ = include;
+	layerFilter_ = true;
+}
+
+void DxfReader::SetLayerPredicate(DxfLayerPredicate predicate, void* userData)
+{
+	ClearLayerFilter();
+
+	layerPredicate_ = predicate;
+	layerPredicateData_ = userData;
+	layerFilter_ = predicate != 0;
+}
+
+void DxfReader::ClearLayerFilter()
+{
+	layerFilter_ = false;
+	filterLayers_.Clear();
+	filterInclude_ = true;
+	layerPredicate_ = 0;
+	layerPredicateData_ = 0;
+	layerDecisions_.Clear();
+}
+
+bool DxfReader::IsFiltered(unsigned layer)
+{
+	if (!layerFilter_ || currentBlock_ != DXF_NO_BLOCK || layer == DXF_NO_LAYER) {
+		return false;
+	}
+
+	if (layer >= layerDecisions_.Size()) {
+		unsigned size = layerDecisions_.Size();
+		layerDecisions_.Resize(layer + 1);
+		memset(&layerDecisions_[size], 0, layer + 1 - size);
+	}
+
+	if (!layerDecisions_[layer]) {
+		const String& name = document_->GetLayers()[layer];
+		bool read = layerPredicate_ ? layerPredicate_(name, layerPredicateData_) : filterLayers_.Contains(name) == filterInclude_;
+		layerDecisions_[layer] = read ? 1 : 2;
+	}
+
+	return layerDecisions_[layer] == 2;
+}
+
+void DxfReader::SkipFiltered(DxfOffset start, bool polyline)
+{
+	//a POLYLINE goes on through its VERTEX entities; its SEQEND is skipped as an unknown entity
+	while (!IsEnd(nextPair_)) {
+		if (nextPair_.code_ == 0 && (!polyline || nextPair_.Equals("SEQEND") || nextPair_.Equals("ENDSEC"))) {
+			break;
+		}
+		GetNextGroup();
+	}
+
+	++filteredEntities_;
+	filteredBytes_ += groupPosition_ - start;
+}
+
+void DxfReader::SetEntitySelection(const Vector<String>& names)
+{
+	selectedTypes_.Clear();
+
+	for (unsigned i = 0; i < names.Size(); ++i) {
+		selectedTypes_[DxfHash(names[i].CString(), names[i].Length())] = names[i];
+	}
+
+	typeFilter_ = true;
+}
+
+void DxfReader::ClearEntitySelection()
+{
+	selectedTypes_.Clear();
+	typeFilter_ = false;
+	polyfaceOnly_ = false;
+}
+
+bool DxfReader::IsSelected(const DxfGroup& group) const
+{
+	//the ends of a parsed POLYLINE are not entities of their own
+	if (group.Equals("VERTEX") || group.Equals("SEQEND")) {
+		return true;
+	}
+
+	HashMap<StringHash, String>::ConstIterator i = selectedTypes_.Find(group.GetHash());
+	return i != selectedTypes_.End() && group.Equals(i->second_.CString());
+}
+
+void DxfReader::SkipUnselected()
+{
+	DxfOffset start = groupPosition_;
+	bool polyline = nextPair_.Equals("POLYLINE");
+
+	while (true) {
+		if (!tokenizer_.NextEntity(nextPair_, groupPosition_)) {
+			groupPosition_ = tokenizer_.GetPosition();
+			break;
+		}
+
+		if (!polyline || !(nextPair_.Equals("VERTEX") || nextPair_.Equals("SEQEND"))) {
+			break;
+		}
+	}
+
+	++filteredEntities_;
+	filteredBytes_ += groupPosition_ - start;
+}
+
+const DxfGroup& DxfReader::GetNextGroup()
+{
+	groupPosition_ = tokenizer_.GetPosition();
+	tokenizer_.Next(nextPair_);
+
+	return nextPair_;
+}
+
+LinePair DxfReader::GetNextLinePair()
+{
+	GetNextGroup();
+
+	//initialize with error code:
+	LinePair pair;
+	pair.first_ = nextPair_.code_;
+	pair.second_ = Variant();
+
+	if (nextPair_.code_ != DXF_INVALID_CODE)
+	{
+		pair.second_ = nextPair_.GetString();
+	}
+
+	return pair;
+}
+
+bool DxfReader::Is(const DxfGroup& group, int code, const char* name)
+{
+	return group.Is(code, name);
+}
+
+bool DxfReader::Is(LinePair pair, int code, String name)
+{
+	bool res = false;
+
+	if (pair.first_ == code && pair.second_ == name)
+	{
+		res = true;
+	}
+
+	return res;
+}
+
+bool DxfReader::IsType(LinePair pair, int code, VariantType type)
+{
+	bool res = false;
+
+	if (pair.first_ == code && pair.second_.GetType() == type)
+	{
+		res = true;
+	}
+
+	return res;
+}
+
+bool DxfReader::IsEnd(const DxfGroup& group)
+{
+	bool res = false;
+
+	//check for actual file end
+	if (group.code_ == DXF_INVALID_CODE || tokenizer_.IsEof())
+	{
+		res = true;
+	}
+
+	//check end of file return code
+	if (group.Is(0, "EOF"))
+	{
+		res = true;
+	}
+
+	return res;
+}
+
+bool DxfReader::IsEnd(LinePair pair)
+{
+	bool res = false;
+
+	//check for actual file end
+	if (pair.first_ == DXF_INVALID_CODE || tokenizer_.IsEof())
+	{
+		res = true;
+	}
+
+	//check end of file return code
+	if (pair.first_ == 0 && pair.second_ == "EOF")
+	{
+		res = true;
+	}
+
+	return res;
+}
+
+bool DxfReader::Parse()
+{
+	memset(warnings_, 0, sizeof warnings_);
+	filteredEntities_ = 0;
+	filteredBytes_ = 0;
+	culledEntities_ = 0;
+	fromCache_ = false;
+	handles_.Clear();
+
+	//a cached document saves the whole parse
+	bool cacheable = IsCacheable();
+	DxfCacheKey cacheKey;
+	if (cacheable) {
+		cacheKey = GetCacheKey();
+
+		SharedPtr<DxfDocument> cached(new DxfDocument());
+		if (LoadDxfCache(GetCachePath(cacheKey), cacheKey, *cached)) {
+			DXF_LOGINFO("DXF: document taken from the cache");
+			document_ = cached;
+			handler_ = document_.Get();
+			origin_ = document_->GetOrigin();
+			originResolved_ = true;
+			fromCache_ = true;
+			return true;
+		}
+	}
+
+	while (!tokenizer_.IsEof())
+	{
+		GetNextGroup();
+
+		//debug
+		//URHO3D_LOGINFO("Line Pair: " + String(nextPair_.code_) + " : " + nextPair_.GetString());
+
+		// blocks table - these 'build blocks' are later (in ENTITIES)
+		// referenced an included via INSERT statements.
+		if (Is(nextPair_, 2, "BLOCKS")) {
+			ParseBlocks();
+			continue;
+		}
+
+		// primary entity table
+		if (Is(nextPair_, 2, "ENTITIES")) {
+			ParseEntities();
+			continue;
+		}
+
+		// skip unneeded sections entirely to avoid any problems with them
+		// alltogether.
+		else if (Is(nextPair_, 2, "CLASSES") || Is(nextPair_, 2, "TABLES")) {
+			SkipSection();
+			continue;
+		}
+
+		else if (Is(nextPair_, 2, "HEADER")) {
+			ParseHeader();
+			continue;
+		}
+
+		// comments
+		else if (nextPair_.code_ == 999) {
+			DXF_LOGDEBUG("DXF comment");
+		}
+
+		// don't read past the official EOF sign
+		else if (IsEnd(nextPair_)) {
+			DXF_LOGINFO("---END OF DXF FILE---");
+			break;
+		}
+
+	}
+
+	ReportWarnings();
+
+	//INSERTs can come before or after their BLOCK, so they are resolved at the end
+	unsigned dropped = document_->ResolveInsertions();
+	if (dropped) {
+		DXF_LOGWARNING("DXF: " + String(dropped) + " INSERTs name no block or close a cycle");
+	}
+
+	if (cacheable && !SaveDxfCache(GetContext(), GetCachePath(cacheKey), cacheKey, *document_, cacheCompress_)) {
+		DXF_LOGWARNING("DXF: could not write the cache to " + cacheDirectory_);
+	}
+
+	return true;
+}
+
+void DxfReader::RunEntityParser(DxfEntityParser parser)
+{
+	if (!handleIndex_) {
+		parser(*this);
+		return;
+	}
+
+	DxfOffset start = groupPosition_;
+	unsigned before = document_->GetEntities().Size();
+	entityHandle_ = DXF_NO_HANDLE;
+	entityOwner_ = DXF_NO_HANDLE;
+
+	parser(*this);
+
+	DxfHandleRecord record;
+	record.handle_ = entityHandle_;
+	record.owner_ = entityOwner_;
+	record.slot_ = document_->GetEntities().Size() > before ? before : DXF_NO_SLOT;
+	record.offset_ = start;
+	handles_.Add(record);
+}
+
+void DxfReader::ReadHandle()
+{
+	if (!handleIndex_) {
+		return;
+	}
+
+	unsigned long long handle = DxfParseHandle(nextPair_.value_, nextPair_.length_);
+
+	if (nextPair_.code_ == 5) {
+		if (entityHandle_ == DXF_NO_HANDLE) {
+			entityHandle_ = handle;
+		}
+	}
+	else if (nextPair_.code_ == 330) {
+		entityOwner_ = handle;
+	}
+}
+
+bool DxfReader::ParseEntityByHandle(const String& handle)
+{
+	Index("ENTITIES");
+
+	const DxfHandleRecord* record = handles_.Find(handle);
+	if (!record) {
+		return false;
+	}
+
+	//entity offsets are in file order
+	if (entityOffsets_.Empty()) {
+		return false;
+	}
+
+	const DxfOffset* first = &entityOffsets_[0];
+	const DxfOffset* last = first + entityOffsets_.Size();
+	const DxfOffset* found = std::lower_bound(first, last, record->offset_);
+	if (found == last || *found != record->offset_) {
+		return false;
+	}
+
+	return ParseEntityAt((unsigned)(found - first));
+}
+
+void DxfReader::SetCacheDirectory(const String& directory, bool compress)
+{
+	cacheDirectory_ = directory;
+	cacheCompress_ = compress;
+
+	//the modification times come from the file system
+	if (!GetSubsystem<FileSystem>()) {
+		GetContext()->RegisterSubsystem(new FileSystem(GetContext()));
+	}
+}
+
+bool DxfReader::IsCacheable() const
+{
+	//a blob does not say what parsed it, so registered parsers go without the cache
+	return !cacheDirectory_.Empty() && handler_ == document_.Get() && !layerFilter_ && !typeFilter_ &&
+		!polyfaceOnly_ && !query_.IsActive() && !handleIndex_ && !customParsers_;
+}
+
+DxfCacheKey DxfReader::GetSourceKey() const
+{
+	DxfCacheKey key;
+	key.size_ = tokenizer_.GetSize();
+	key.hash_ = DxfContentHash(tokenizer_.GetData(), tokenizer_.GetSize());
+
+	if (!path_.Empty()) {
+		key.modified_ = GetSubsystem<FileSystem>()->GetLastModifiedTime(path_);
+	}
+
+	return key;
+}
+
+DxfCacheKey DxfReader::GetCacheKey() const
+{
+	DxfCacheKey key = GetSourceKey();
+
+	//the settings that move the vertices, or add precise ones
+	double options[] = { (double)precise_, (double)autoOrigin_, (double)originResolved_, origin_.x_, origin_.y_, origin_.z_ };
+	key.options_ = DxfContentHash(options, sizeof options);
+
+	return key;
+}
+
+String DxfReader::GetCachePath(const DxfCacheKey& key) const
+{
+	//one blob per file, so a changed file replaces its old one
+	unsigned long long name = path_.Empty() ? key.hash_ : DxfContentHash(path_.CString(), path_.Length());
+	return AddTrailingSlash(cacheDirectory_) + ToStringHex((unsigned)(name >> 32)) + ToStringHex((unsigned)name) + ".dxfc";
+}
+
+void DxfReader::ReportWarnings()
+{
+	for (unsigned i = 0; i < MAX_DXF_WARNINGS; ++i) {
+		if (warnings_[i]) {
+			DXF_LOGWARNING("DXF: " + String(warnings_[i]) + " " + warningMessages[i]);
+		}
+	}
+}
+
+void DxfReader::SkipSection()
+{
+	DXF_LOGINFO("Skipping section...");
+
+	GetNextGroup();
+
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC"))
+	{
+		GetNextGroup();
+	}
+}
+
+void DxfReader::SkipEntity()
+{
+	GetNextGroup();
+
+	while (!IsEnd(nextPair_) && nextPair_.code_ != 0)
+	{
+		GetNextGroup();
+	}
+}
+
+void DxfReader::ParseHeader()
+{
+	DXF_LOGINFO("Parsing header...");
+
+	GetNextGroup();
+
+	DxfHeader& header = document_->GetHeader();
+	Vector3* variable = 0;
+
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC"))
+	{
+		switch (nextPair_.code_)
+		{
+			// a variable name, the groups that follow are its value
+		case 9:
+			variable = 0;
+			if (nextPair_.Equals("$EXTMIN")) {
+				variable = &header.extentsMin_;
+				header.fields_ |= DXF_HEADER_EXTMIN;
+			}
+			else if (nextPair_.Equals("$EXTMAX")) {
+				variable = &header.extentsMax_;
+				header.fields_ |= DXF_HEADER_EXTMAX;
+			}
+			break;
+
+		case 10:
+			if (variable)
+				variable->x_ = nextPair_.GetFloat();
+			break;
+
+		case 20:
+			if (variable)
+				variable->y_ = nextPair_.GetFloat();
+			break;
+
+		case 30:
+			if (variable)
+				variable->z_ = nextPair_.GetFloat();
+			break;
+		}
+
+		GetNextGroup();
+	}
+}
+
+void DxfReader::Index(const char* until)
+{
+	//already past the section we want?
+	if (indexComplete_) {
+		return;
+	}
+
+	if (until) {
+		for (unsigned i = 0; i < sections_.Size(); ++i) {
+			if (sections_[i].name_ == until && sections_[i].end_ != DXF_NO_OFFSET) {
+				return;
+			}
+		}
+	}
+
+	//only the group codes and entity names are looked at, nothing is converted
+	DxfTokenizer scanner(tokenizer_);
+	scanner.Seek(indexPosition_);
+	DxfGroup group;
+
+	//the handle of the top-level entity being scanned, recorded at the next 0 group
+	DxfHandleRecord entity;
+	entity.handle_ = DXF_NO_HANDLE;
+	entity.owner_ = DXF_NO_HANDLE;
+	entity.slot_ = DXF_NO_SLOT;
+	entity.offset_ = 0;
+
+	while (true) {
+		DxfOffset position = scanner.GetPosition();
+
+		if (!scanner.Next(group) || group.Is(0, "EOF")) {
+			indexComplete_ = true;
+			break;
+		}
+
+		if (group.code_ != 0) {
+			if (handleIndex_ && entity.offset_) {
+				if (group.code_ == 5 && entity.handle_ == DXF_NO_HANDLE) {
+					entity.handle_ = DxfParseHandle(group.value_, group.length_);
+				}
+				else if (group.code_ == 330) {
+					entity.owner_ = DxfParseHandle(group.value_, group.length_);
+				}
+			}
+			continue;
+		}
+
+		//parsed entities keep their slot
+		if (entity.offset_) {
+			const DxfHandleRecord* parsed = handles_.Find(entity.handle_);
+			if (!parsed || parsed->offset_ != entity.offset_) {
+				handles_.Add(entity);
+			}
+			entity.handle_ = DXF_NO_HANDLE;
+			entity.owner_ = DXF_NO_HANDLE;
+			entity.offset_ = 0;
+		}
+
+		if (group.Equals("SECTION")) {
+			scanner.Next(group);
+			indexSection_ = sections_.Size();
+			sections_.Resize(sections_.Size() + 1);
+			sections_.Back().name_ = group.GetString();
+			sections_.Back().start_ = scanner.GetPosition();
+			continue;
+		}
+
+		if (indexSection_ == M_MAX_UNSIGNED) {
+			continue;
+		}
+
+		DxfSection& section = sections_[indexSection_];
+
+		if (group.Equals("ENDSEC")) {
+			section.end_ = position;
+			indexSection_ = M_MAX_UNSIGNED;
+			indexInPolyline_ = false;
+
+			if (until && section.name_ == until) {
+				break;
+			}
+			continue;
+		}
+
+		if (section.name_ == "BLOCKS") {
+			if (group.Equals("BLOCK")) {
+				blockOffsets_.Push(position);
+				blockParsed_.Push(false);
+			}
+		}
+
+		//a POLYLINE runs until SEQEND, its VERTEX groups are not entities of their own
+		else if (section.name_ == "ENTITIES") {
+			if (indexInPolyline_) {
+				indexInPolyline_ = !group.Equals("SEQEND");
+				continue;
+			}
+
+			entityOffsets_.Push(position);
+			entityParsed_.Push(false);
+			indexInPolyline_ = group.Equals("POLYLINE");
+			entity.offset_ = position;
+		}
+	}
+
+	indexPosition_ = scanner.GetPosition();
 }
 
+void DxfReader::BuildIndex()
+{
+	Index(0);
+}
 
-DxfReader::DxfReader(Context* context, String path) : Object(context)
+DxfSection* DxfReader::FindSection(const String& name)
 {
-	FileSystem* fs = new FileSystem(GetContext());
-	bool res = fs->FileExists(path);
+	Index(name.CString());
 
-	//make sure that this file exists
-	assert(res);
+	for (unsigned i = 0; i < sections_.Size(); ++i) {
+		if (sections_[i].name_ == name) {
+			return &sections_[i];
+		}
+	}
 
-	//create the file
-	source_ = new File(GetContext(), path, FILE_READ);
+	return 0;
+}
 
-	//double check
-	assert(source_);
+const DxfSection* DxfReader::GetSection(const String& name)
+{
+	return FindSection(name);
+}
 
-	//create the log
-	GetContext()->RegisterSubsystem(new Log(GetContext()));
+unsigned DxfReader::GetNumBlocks()
+{
+	Index("BLOCKS");
+	return blockOffsets_.Size();
+}
 
+unsigned DxfReader::GetNumEntities()
+{
+	Index("ENTITIES");
+	return entityOffsets_.Size();
 }
 
-LinePair DxfReader::GetNextLinePair()
+bool DxfReader::ParseSection(const String& name)
 {
-	//LinePair nextPair;
-	
-	//initialize with error code:
-	nextPair.first_ = -100; //use this as error since DXF has some negative codes...
-	nextPair.second_ = Variant();
+	DxfSection* section = FindSection(name);
 
-	//read the code
-	if (!source_->IsEof())
-	{
-		nextPair.first_ = ToInt(source_->ReadLine().Trimmed());
+	if (!section) {
+		return false;
 	}
 
-	//read the value
-	if (!source_->IsEof())
-	{
-		nextPair.second_ = source_->ReadLine().Trimmed();
+	if (section->parsed_) {
+		return true;
+	}
+	section->parsed_ = true;
+
+	//blocks or entities that were parsed one by one are not parsed again
+	bool piecewise = false;
+	if (name == "BLOCKS") {
+		piecewise = blockParsed_.Contains(true);
+	}
+	else if (name == "ENTITIES") {
+		piecewise = entityParsed_.Contains(true);
+	}
+
+	if (piecewise) {
+		DXF_LOGINFO("Parsing the rest of " + name + "...");
+
+		if (name == "ENTITIES") {
+			DxfBlock& block = document_->AddBlock();
+			block.name_ = "$GENERIC_BLOCK_NAME";
+			block.generic_ = true;
+
+			for (unsigned i = 0; i < entityOffsets_.Size(); ++i) {
+				ParseEntityAt(i);
+			}
+		}
+		else {
+			for (unsigned i = 0; i < blockOffsets_.Size(); ++i) {
+				ParseBlockAt(i);
+			}
+		}
+
+		return true;
 	}
 
-	currLineNumber += 2;
+	tokenizer_.Seek(section->start_);
+
+	if (name == "HEADER") {
+		ParseHeader();
+	}
+	else if (name == "BLOCKS") {
+		ParseBlocks();
+		for (unsigned i = 0; i < blockParsed_.Size(); ++i) {
+			blockParsed_[i] = true;
+		}
+	}
+	else if (name == "ENTITIES") {
+		ParseEntities();
+		for (unsigned i = 0; i < entityParsed_.Size(); ++i) {
+			entityParsed_[i] = true;
+		}
+	}
 
-	return nextPair;
+	return true;
 }
 
-bool DxfReader::Is(LinePair pair, int code, String name)
+bool DxfReader::ParseBlockAt(unsigned index)
 {
-	bool res = false;
+	if (index >= GetNumBlocks()) {
+		return false;
+	}
 
-	if (pair.first_ == code && pair.second_ == name)
-	{
-		res = true;
+	if (!blockParsed_[index]) {
+		blockParsed_[index] = true;
+
+		//ParseBlock() starts at the 0/BLOCK group
+		tokenizer_.Seek(blockOffsets_[index]);
+		GetNextGroup();
+		ParseBlock();
 	}
 
-	return res;
+	return true;
 }
 
-bool DxfReader::IsType(LinePair pair, int code, VariantType type)
+bool DxfReader::ParseEntityAt(unsigned index)
 {
-	bool res = false;
+	if (index >= GetNumEntities()) {
+		return false;
+	}
 
-	if (pair.first_ == code && pair.second_.GetType() == type)
-	{
-		res = true;
+	if (!entityParsed_[index]) {
+		entityParsed_[index] = true;
+
+		//the parsers start at the 0 group that names the entity
+		tokenizer_.Seek(entityOffsets_[index]);
+		GetNextGroup();
+
+		DxfEntityParser parser = GetEntityParser(nextPair_);
+		if (parser) {
+			RunEntityParser(parser);
+		}
 	}
 
-	return res;
+	return true;
 }
 
-bool DxfReader::IsEnd(LinePair pair)
+void DxfReader::ParseEntities()
 {
-	bool res = false;
+	DXF_LOGINFO("Parsing entities...");
 
-	//check for actual file end
-	if (pair.first_ == -100 || source_->IsEof())
-	{
-		res = true;
+	//create a block and push it to list
+	DxfBlock& block = document_->AddBlock();
+	block.name_ = "$GENERIC_BLOCK_NAME";
+	block.generic_ = true;
+
+	//a loaded bounds index saves parsing what the query does not meet
+	if (query_.IsActive() && ParseEntitiesIndexed()) {
+		return;
 	}
+	entityBounds_.Clear();
+	boundsLoaded_ = false;
 
-	//check end of file return code
-	if (pair.first_ == 0 && pair.second_ == "EOF")
-	{
-		res = true;
+	//a streaming handler keeps nothing, so there is nothing to reserve
+	if (precount_ && handler_ == document_.Get()) {
+		PrecountEntities();
 	}
 
-	return res;
+	//the WorkQueue belongs to the main thread; readers on other threads parse serially.
+	//chunks are merged into the document, so a streaming handler parses serially too.
+	if (parallel_ && handler_ == document_.Get() && Thread::IsMainThread() && ParseEntitiesParallel()) {
+		return;
+	}
+
+	GetNextGroup();
+
+	ParseEntityRange(DXF_NO_OFFSET);
 }
 
-bool DxfReader::Parse()
+void DxfReader::PrecountEntities()
 {
-	while (!source_->IsEof())
-	{
-		nextPair = GetNextLinePair();
+	//the same counts the parsers will produce: one vertex per VERTEX record (face records included),
+	//4 corners per face or line, and the face indices inside VERTEX records
+	unsigned numEntities = 0;
+	unsigned numVertices = 0;
+	unsigned numIndices = 0;
+	bool inVertex = false;
+
+	DxfTokenizer scanner(tokenizer_);
+	DxfGroup group;
+
+	while (scanner.Next(group) && !group.Is(0, "ENDSEC") && !group.Is(0, "EOF")) {
+		if (group.code_ != 0) {
+			if (inVertex && group.code_ >= 71 && group.code_ <= 74) {
+				++numIndices;
+			}
+			continue;
+		}
 
-		//debug
-		//URHO3D_LOGINFO("Line Pair: " + String(nextPair.first_) + " : " + nextPair.second_.GetString());
+		inVertex = group.Equals("VERTEX");
+		if (inVertex) {
+			++numVertices;
+		}
+		else if (group.Equals("POLYLINE")) {
+			++numEntities;
+		}
+		else if (group.Equals("POINT")) {
+			++numEntities;
+			++numVertices;
+		}
+		else if (group.Equals("3DFACE") || group.Equals("LINE") || group.Equals("3DLINE")) {
+			++numEntities;
+			numVertices += 4;
+		}
+	}
 
-		// blocks table - these 'build blocks' are later (in ENTITIES)
-		// referenced an included via INSERT statements.
-		if (Is(nextPair, 2, "BLOCKS")) {
-			ParseBlocks();
+	document_->Reserve(numEntities, numVertices, numIndices);
+}
+
+void DxfReader::ParseEntityRange(DxfOffset end)
+{
+	//the query sits between the parsers and the handler, and measures every entity
+	bool bounds = query_.IsActive() || recordBounds_;
+	DxfEntityHandler* handler = handler_;
+	if (bounds) {
+		query_.SetTarget(handler_);
+		handler_ = &query_;
+	}
+
+	//proceed
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC") && groupPosition_ < end) {
+
+		//entities start at a 0 group; anything else is left over from one we skipped
+		if (nextPair_.code_ != 0) {
+			GetNextGroup();
 			continue;
 		}
 
-		// primary entity table
-		if (Is(nextPair, 2, "ENTITIES")) {
-			ParseEntities();
+		//unselected entities are indexed without bounds, so they are read again by a query without the selection
+		DxfOffset start = groupPosition_;
+
+		if (typeFilter_ && !IsSelected(nextPair_)) {
+			SkipUnselected();
+			if (bounds) {
+				entityBounds_.Push(DxfEntityBounds(start, BoundingBox()));
+			}
 			continue;
 		}
 
-		// skip unneeded sections entirely to avoid any problems with them
-		// alltogether.
-		else if (Is(nextPair, 2, "CLASSES") || Is(nextPair, 2, "TABLES")) {
-			SkipSection();
+		//one lookup per entity, unknown ones are skipped whole
+		DxfEntityParser parser = GetEntityParser(nextPair_);
+		if (parser) {
+			query_.BeginEntity();
+			RunEntityParser(parser);
+			if (bounds) {
+				entityBounds_.Push(DxfEntityBounds(start, query_.GetBounds()));
+			}
+		}
+		else {
+			SkipEntity();
+		}
+	}
+
+	if (bounds) {
+		culledEntities_ += query_.GetNumCulled();
+		handler_ = handler;
+	}
+
+	entitiesEnd_ = groupPosition_;
+}
+
+void DxfReader::ParseEntityChunk()
+{
+	tokenizer_.Seek(chunkStart_);
+	GetNextGroup();
+
+	ParseEntityRange(chunkEnd_);
+}
+
+bool DxfReader::ParseEntitiesParallel()
+{
+	//pre-scan the section for entity starts to split at. Only the group codes are looked at.
+	//we must not split where the serial parser carries state from one entity into the next:
+	//inside a POLYLINE (it runs until SEQEND).
+	//chunks must agree on the origin. Without $EXTMIN it comes from the first position, which only a serial parse knows.
+	if (autoOrigin_ && !originResolved_) {
+		if (!(document_->GetHeader().fields_ & DXF_HEADER_EXTMIN)) {
+			return false;
+		}
+		ResolveAutoOrigin(DxfVector3d());
+	}
+
+	PODVector<DxfOffset> starts;
+	starts.Push(tokenizer_.GetPosition());
+
+	DxfTokenizer scanner(tokenizer_);
+	DxfGroup group;
+	bool inPolyline = false;
+
+	while (true) {
+		DxfOffset position = scanner.GetPosition();
+
+		if (!scanner.Next(group) || scanner.IsEof() || group.Is(0, "ENDSEC") || group.Is(0, "EOF")) {
+			break;
+		}
+
+		if (group.code_ != 0) {
 			continue;
 		}
 
-		else if (Is(nextPair, 2, "HEADER")) {
-			ParseHeader();
+		if (inPolyline) {
+			inPolyline = !group.Equals("SEQEND");
 			continue;
 		}
 
-		// comments
-		else if (nextPair.first_ == 999) {
-		URHO3D_LOGINFO("DXF comment");
+		if (position - starts.Back() >= chunkSize_) {
+			starts.Push(position);
 		}
 
-		// don't read past the official EOF sign
-		else if (IsEnd(nextPair)) {
-			URHO3D_LOGINFO("---END OF DXF FILE---");
-			break;
+		inPolyline = group.Equals("POLYLINE");
+	}
+
+	if (starts.Size() < 2) {
+		return false;
+	}
+
+	WorkQueue* queue = GetWorkQueue();
+
+	//chunk readers are created and destroyed here on the main thread, only their parse runs on the workers
+	Vector<SharedPtr<DxfReader> > chunks;
+	for (unsigned i = 0; i < starts.Size(); ++i) {
+		DxfOffset end = i + 1 < starts.Size() ? starts[i + 1] : DXF_NO_OFFSET;
+		chunks.Push(SharedPtr<DxfReader>(new DxfReader(GetContext(), tokenizer_, starts[i], end)));
+		chunks.Back()->entityParsers_ = entityParsers_;
+		chunks.Back()->precise_ = precise_;
+		//the filter, but not its decisions: chunk documents number their layers anew
+		chunks.Back()->layerFilter_ = layerFilter_;
+		chunks.Back()->filterLayers_ = filterLayers_;
+		chunks.Back()->filterInclude_ = filterInclude_;
+		chunks.Back()->layerPredicate_ = layerPredicate_;
+		chunks.Back()->layerPredicateData_ = layerPredicateData_;
+		chunks.Back()->typeFilter_ = typeFilter_;
+		chunks.Back()->selectedTypes_ = selectedTypes_;
+		chunks.Back()->polyfaceOnly_ = polyfaceOnly_;
+		chunks.Back()->query_ = query_;
+		chunks.Back()->recordBounds_ = recordBounds_;
+		chunks.Back()->handleIndex_ = handleIndex_;
+		if (originResolved_) {
+			chunks.Back()->SetOrigin(origin_);
 		}
 
+		SharedPtr<WorkItem> item = queue->GetFreeItem();
+		item->priority_ = M_MAX_UNSIGNED;
+		item->workFunction_ = ParseEntityChunkWork;
+		item->start_ = chunks.Back().Get();
+		queue->AddWorkItem(item);
 	}
 
-	return true;
-}
+	DXF_LOGINFO("Parsing entities in " + String(chunks.Size()) + " chunks...");
 
-void DxfReader::SkipSection()
-{
-	URHO3D_LOGINFO("Skipping section...");
+	queue->Complete(M_MAX_UNSIGNED);
 
-	nextPair = GetNextLinePair();
+	//merge in file order
+	for (unsigned i = 0; i < chunks.Size(); ++i) {
+		document_->Append(*chunks[i]->document_);
 
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDSEC"))
-	{
-		nextPair = GetNextLinePair();
+		for (unsigned j = 0; j < MAX_DXF_WARNINGS; ++j) {
+			warnings_[j] += chunks[i]->warnings_[j];
+		}
+
+		filteredEntities_ += chunks[i]->filteredEntities_;
+		filteredBytes_ += chunks[i]->filteredBytes_;
+		culledEntities_ += chunks[i]->culledEntities_;
+		handles_.Append(chunks[i]->handles_, document_->GetEntities().Size() - chunks[i]->document_->GetEntities().Size());
+		entityBounds_.Push(chunks[i]->entityBounds_);
 	}
-}
 
-void DxfReader::ParseHeader()
-{
-	URHO3D_LOGINFO("Parsing header...");
+	//continue after the section, where the last chunk stopped
+	const DxfReader* last = chunks.Back();
+	tokenizer_.Seek(last->tokenizer_.GetPosition());
+	groupPosition_ = last->groupPosition_;
+	nextPair_ = last->nextPair_;
+	entitiesEnd_ = last->entitiesEnd_;
 
-	SkipSection();
+	return true;
 }
 
-void DxfReader::ParseEntities()
+bool DxfReader::ParseEntitiesIndexed()
 {
-	URHO3D_LOGINFO("Parsing entities...");
+	//the size first, it is free; an edit of the same length still changes the hash
+	if (!boundsLoaded_ || boundsKey_.size_ != tokenizer_.GetSize() || boundsKey_ != GetSourceKey()) {
+		return false;
+	}
 
-	nextPair = GetNextLinePair();
+	//the bounds are in the local frame they were made in
+	if (autoOrigin_ && !originResolved_) {
+		if (!(document_->GetHeader().fields_ & DXF_HEADER_EXTMIN)) {
+			return false;
+		}
+		ResolveAutoOrigin(DxfVector3d());
+	}
 
-	//create a block and push it to list
-	VariantMap block;
-	block["000_TYPE"] = "BLOCK";
-	block["Name"] = "$GENERIC_BLOCK_NAME";
-	block["Insertions"] = VariantVector();
-	block["Lines"] = VariantVector();
-	blocks_.Push(block);
+	if (origin_ != boundsOrigin_) {
+		return false;
+	}
 
-	//proceed
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDSEC")) {
+	//a cheap check that the offsets are still of this file
+	DxfTokenizer scanner(tokenizer_);
+	DxfGroup group;
+	scanner.Seek(entitiesEnd_);
+	if (!scanner.Next(group) || !group.Is(0, "ENDSEC")) {
+		return false;
+	}
 
-		if (Is(nextPair, 0, "POLYLINE")) {
-			ParsePolyLine();
-			continue;
-		}
+	DXF_LOGINFO("Parsing entities from the bounds index...");
+
+	//the layers in the order of a full parse, which met them all
+	for (unsigned i = 0; i < boundsLayers_.Size(); ++i) {
+		document_->AddLayer(boundsLayers_[i].CString(), boundsLayers_[i].Length());
+	}
 
-		else if (Is(nextPair, 0, "INSERT")) {
-			ParseInsertion();
+	for (unsigned i = 0; i < entityBounds_.Size(); ++i) {
+		if (!query_.Intersects(entityBounds_[i].bounds_)) {
+			++culledEntities_;
 			continue;
 		}
 
-		else if (Is(nextPair, 0, "POINT")) {
-			ParsePoint();
+		tokenizer_.Seek(entityBounds_[i].offset_);
+		GetNextGroup();
+
+		if (typeFilter_ && !IsSelected(nextPair_)) {
+			SkipUnselected();
 			continue;
 		}
 
-		//parse these types
-		else if (Is(nextPair, 0, "3DFACE") || Is(nextPair, 0, "LINE") || Is(nextPair, 0, "3DLINE")) {
-			//http://sourceforge.net/tracker/index.php?func=detail&aid=2970566&group_id=226462&atid=1067632
-			Parse3DFace();
-			continue;
+		DxfEntityParser parser = GetEntityParser(nextPair_);
+		if (parser) {
+			RunEntityParser(parser);
 		}
+	}
 
-		//recurse
-		nextPair = GetNextLinePair();
+	//continue at the 0/ENDSEC group, as after a full parse
+	tokenizer_.Seek(entitiesEnd_);
+	GetNextGroup();
+
+	return true;
+}
+
+bool DxfReader::SaveBoundsIndex(const String& path)
+{
+	if (entitiesEnd_ == DXF_NO_OFFSET) {
+		return false;
+	}
+
+	File file(GetContext(), path, FILE_WRITE);
+	if (!file.IsOpen()) {
+		return false;
+	}
+
+	DxfCacheKey key = GetSourceKey();
+
+	file.WriteFileID("DXFB");
+	file.WriteUInt(DXF_BOUNDS_VERSION);
+	file.WriteUInt64(key.size_);
+	file.WriteUInt(key.modified_);
+	file.WriteUInt64(key.hash_);
+	file.WriteDouble(origin_.x_);
+	file.WriteDouble(origin_.y_);
+	file.WriteDouble(origin_.z_);
+	file.WriteUInt64(entitiesEnd_);
+	file.WriteUInt(entityBounds_.Size());
+
+	for (unsigned i = 0; i < entityBounds_.Size(); ++i) {
+		file.WriteUInt64(entityBounds_[i].offset_);
+		file.WriteBoundingBox(entityBounds_[i].bounds_);
+	}
+
+	//the layer table, so the layer ids come out the same
+	file.WriteStringVector(document_->GetLayers());
+
+	return true;
+}
+
+bool DxfReader::LoadBoundsIndex(const String& path)
+{
+	File file(GetContext());
+	if (!file.Open(path) || file.ReadFileID() != "DXFB" || file.ReadUInt() != DXF_BOUNDS_VERSION) {
+		return false;
+	}
+
+	boundsKey_.size_ = file.ReadUInt64();
+	boundsKey_.modified_ = file.ReadUInt();
+	boundsKey_.hash_ = file.ReadUInt64();
+	boundsOrigin_.x_ = file.ReadDouble();
+	boundsOrigin_.y_ = file.ReadDouble();
+	boundsOrigin_.z_ = file.ReadDouble();
+	DxfOffset end = file.ReadUInt64();
+	unsigned count = file.ReadUInt();
+
+	//an offset and a min and max corner per entity
+	if (file.GetSize() - file.GetPosition() < (unsigned long long)count * (sizeof(DxfOffset) + 2 * sizeof(Vector3))) {
+		return false;
+	}
+
+	entitiesEnd_ = end;
+	entityBounds_.Resize(count);
+
+	for (unsigned i = 0; i < count; ++i) {
+		entityBounds_[i].offset_ = file.ReadUInt64();
+		entityBounds_[i].bounds_ = file.ReadBoundingBox();
+	}
+
+	boundsLayers_ = file.ReadStringVector();
+
+	boundsLoaded_ = file.GetPosition() == file.GetSize();
+	return boundsLoaded_;
+}
+
+WorkQueue* DxfReader::GetWorkQueue()
+{
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+
+	if (!queue) {
+		//the main thread takes part in Complete(), so leave one core for it
+		queue = new WorkQueue(GetContext());
+		GetContext()->RegisterSubsystem(queue);
+		queue->CreateThreads(Max((int)GetNumLogicalCPUs() - 1, 1));
 	}
+
+	return queue;
 }
 
 void DxfReader::ParseBlocks()
 {
-	URHO3D_LOGINFO("Parsing blocks...");
+	DXF_LOGINFO("Parsing blocks...");
 
-	nextPair = GetNextLinePair();
+	GetNextGroup();
 
 	//call individual block parsing loop
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDSEC")) {
-		if (Is(nextPair, 0, "BLOCK")) {
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC")) {
+		if (Is(nextPair_, 0, "BLOCK")) {
 			ParseBlock();
 		}
 		else {
-			nextPair = GetNextLinePair();
+			GetNextGroup();
 		}
 	}
 }
 
 void DxfReader::ParseBlock()
 {
-	URHO3D_LOGINFO("Parsing single block...");
+	DXF_LOGDEBUG("Parsing single block...");
+
+	GetNextGroup();
 
-	nextPair = GetNextLinePair();
+	//we store all block info in the document
+	document_->AddBlock();
 
-	//we store all block info in variant map
-	VariantMap block;
-	//debug
-	block["000_TYPE"] = "BLOCK";
-	block["Insertions"] = VariantVector();
-	block["Lines"] = VariantVector();
-	blocks_.Push(block);
+	//nested entities don't add blocks, so the index stays valid
+	unsigned currBlock = document_->GetBlocks().Size() - 1;
 
-	//get reference to last block
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
+	//block coordinates are not shifted to the origin, and INSERTs in here belong to the block
+	currentBlock_ = currBlock;
 
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDBLK") && !Is(nextPair, 0, "ENDSEC")) {
+	//the entities of the definition follow each other in the document, whatever the handler:
+	//INSERTs are resolved against them at the end of the parse
+	unsigned firstEntity = document_->GetEntities().Size();
+	DxfEntityHandler* handler = handler_;
+	handler_ = document_.Get();
+
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDBLK") && !Is(nextPair_, 0, "ENDSEC")) {
 		
+		DxfBlock& block = document_->GetBlock(currBlock);
+
 		//get the info
-		switch (nextPair.first_) {
+		switch (nextPair_.code_) {
 		case 2:
-			(*currBlock)["Name"] = nextPair.second_.GetString();
+			block.name_ = nextPair_.GetString();
+			block.fields_ |= DXF_BLOCK_NAME;
 			break;
 		case 10:
-			(*currBlock)["Base_X"] = ToFloat(nextPair.second_.GetString());
+			block.base_.x_ = nextPair_.GetFloat();
+			block.fields_ |= DXF_BLOCK_BASE_X;
 			break;
 		case 20:
-			(*currBlock)["Base_Y"] = ToFloat(nextPair.second_.GetString());
+			block.base_.y_ = nextPair_.GetFloat();
+			block.fields_ |= DXF_BLOCK_BASE_Y;
 			break;
 		case 30:
-			(*currBlock)["Base_Z"] = ToFloat(nextPair.second_.GetString());
+			block.base_.z_ = nextPair_.GetFloat();
+			block.fields_ |= DXF_BLOCK_BASE_Z;
 			break;
 		}
 
 		//continue with parsing rest of content
-		if (Is(nextPair, 0, "POLYLINE")) {
-			ParsePolyLine();
-			continue;
-		}
-
-		else if (Is(nextPair, 0, "POINT")) {
-			ParsePoint();
-			continue;
-		}
-
-		//skipping this case
-		if (Is(nextPair, 0, "INSERT")) {
-			URHO3D_LOGERROR("DXF: INSERT within a BLOCK not currently supported; skipping");
-			while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDBLK"))
-			{
-				nextPair = GetNextLinePair();
+		if (nextPair_.code_ == 0) {
+			DxfEntityParser parser = GetEntityParser(nextPair_);
+			if (parser) {
+				RunEntityParser(parser);
+				continue;
 			}
-			break;
-		}
-
-		//parse these types
-		else if (Is(nextPair, 0, "3DFACE") || Is(nextPair, 0, "LINE") || Is(nextPair, 0, "3DLINE")) {
-			//http://sourceforge.net/tracker/index.php?func=detail&aid=2970566&group_id=226462&atid=1067632
-			Parse3DFace();
-			continue;
 		}
 	
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
+
+	currentBlock_ = DXF_NO_BLOCK;
+	handler_ = handler;
+
+	DxfBlock& block = document_->GetBlock(currBlock);
+	block.entityStart_ = firstEntity;
+	block.entityCount_ = document_->GetEntities().Size() - firstEntity;
 }
 
 void DxfReader::ParseInsertion()
 {
-	URHO3D_LOGINFO("Parsing insertion...");
+	DXF_LOGDEBUG("Parsing insertion...");
 
-	nextPair = GetNextLinePair();
+	GetNextGroup();
 
-	//insertions are par to of the block structure
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
+	//we store all insertion info in the document
+	DxfInsertion& insertion = document_->AddInsertion();
+	insertion.parent_ = currentBlock_;
+	DxfVector3d position;
 
-	//we store all insertion info in variant map
-	VariantMap insertion;
-	insertion["000_TYPE"] = "INSERTION";
-
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDBLK")) {
+	//the insertion ends at the next entity. Its ATTRIBs and their SEQEND are skipped as unknown entities.
+	while (!IsEnd(nextPair_) && nextPair_.code_ != 0) {
 
 		//get the info
-		switch (nextPair.first_) {
+		switch (nextPair_.code_) {
+		case 5:
+		case 330:
+			ReadHandle();
+			break;
 		case 2:
-			insertion["Name"] = nextPair.second_.GetString();
+			insertion.name_ = nextPair_.GetString();
+			insertion.fields_ |= DXF_INSERT_NAME;
 			break;
 			//translation
 		case 10:
-			insertion["Position_X"] = ToFloat(nextPair.second_.GetString());
+			position.x_ = GetCoordinate();
+			insertion.fields_ |= DXF_INSERT_POSITION_X;
 			break;
 		case 20:
-			insertion["Position_Y"] = ToFloat(nextPair.second_.GetString());
+			position.y_ = GetCoordinate();
+			insertion.fields_ |= DXF_INSERT_POSITION_Y;
 			break;
 		case 30:
-			insertion["Position_Z"] = ToFloat(nextPair.second_.GetString());
+			position.z_ = GetCoordinate();
+			insertion.fields_ |= DXF_INSERT_POSITION_Z;
 			break;
 			// scaling
 		case 41:
-			insertion["Scale_X"] = ToFloat(nextPair.second_.GetString());
+			insertion.scale_.x_ = nextPair_.GetFloat();
+			insertion.fields_ |= DXF_INSERT_SCALE_X;
 			break;
 		case 42:
-			insertion["Scale_Y"] = ToFloat(nextPair.second_.GetString());
+			insertion.scale_.y_ = nextPair_.GetFloat();
+			insertion.fields_ |= DXF_INSERT_SCALE_Y;
 			break;
 		case 43:
-			insertion["Scale_Z"] = ToFloat(nextPair.second_.GetString());
+			insertion.scale_.z_ = nextPair_.GetFloat();
+			insertion.fields_ |= DXF_INSERT_SCALE_Z;
 			break;
 			// rotation angle
 		case 50:
-			insertion["Angle"] = ToFloat(nextPair.second_.GetString());
+			insertion.angle_ = nextPair_.GetFloat();
+			insertion.fields_ |= DXF_INSERT_ANGLE;
 			break;
 		}
 
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 
-	//done with parsing the insertion. Push to stack
-	insertions_.Push(insertion);
+	//the position is in world coordinates
+	//an insertion has no vertex of its own, so its precise position is not passed on
+	Shift(&position, &insertion.position_, 1);
+
+	//done with parsing the insertion, it is already in the document
 }
 
 void DxfReader::ParseLWPolyLine()
 {
-	URHO3D_LOGINFO("Parseing lwpolyline...");
-
-	nextPair = GetNextLinePair();
+	DXF_LOGDEBUG("Parseing lwpolyline...");
 
-	//get reference to last block
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
+	GetNextGroup();
 
 	//store lwpolyline data in variantmap
 	VariantMap lwpolyline;
@@ -364,33 +1506,33 @@ void DxfReader::ParseLWPolyLine()
 	lwpolyline["Vertices"] = VariantVector();
 	lwpolyline["Faces"] = VariantVector();
 
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDSEC")) {
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC")) {
 
 		// vertex part omitted for now
 
-		switch (nextPair.first_) {
+		switch (nextPair_.code_) {
 		// Common Group Codes for Entities
 		case 8:
-			lwpolyline["Layer"] = nextPair.second_.GetString();
+			lwpolyline["Layer"] = nextPair_.GetString();
 			break;
 		// LWPolyLine codes
 		case 100:
-			lwpolyline["SubclassMarker"] = nextPair.second_.GetString();
+			lwpolyline["SubclassMarker"] = nextPair_.GetString();
 			break;
 		case 90:
-			lwpolyline["NumVertices"] = ToUInt(nextPair.second_.GetString());
+			lwpolyline["NumVertices"] = nextPair_.GetUInt();
 			break;
 		case 70:
-			lwpolyline["PolylineFlag"] = ToUInt(nextPair.second_.GetString());
+			lwpolyline["PolylineFlag"] = nextPair_.GetUInt();
 			break;
 		case 43:
-			lwpolyline["ConstantWidth"] = ToUInt(nextPair.second_.GetString());
+			lwpolyline["ConstantWidth"] = nextPair_.GetUInt();
 			break;
 		case 38:
-			lwpolyline["Elevantion"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["Elevantion"] = nextPair_.GetFloat();
 			break;
 		case 39:
-			lwpolyline["Thickness"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["Thickness"] = nextPair_.GetFloat();
 			break;
 		case 10:
 			// Vertex coordinates (in OCS), multiple entries; ...
@@ -402,55 +1544,58 @@ void DxfReader::ParseLWPolyLine()
 			// Vertex identifier
 			break;
 		case 40:
-			lwpolyline["StartingWidth"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["StartingWidth"] = nextPair_.GetFloat();
 			break;
 		case 41:
 			// Bulge (multiple entries; ...
 			break;
 		case 210:
-			lwpolyline["ExtrusionDirection_X"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["ExtrusionDirection_X"] = nextPair_.GetFloat();
 			break;
 		case 220:
-			lwpolyline["ExtrusionDirection_Y"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["ExtrusionDirection_Y"] = nextPair_.GetFloat();
 			break;
 		case 230:
-			lwpolyline["ExtrusionDirection_Z"] = ToFloat(nextPair.second_.GetString());
+			lwpolyline["ExtrusionDirection_Z"] = nextPair_.GetFloat();
 			break;
 		default:
 			break;
 		}
 
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 }
 
 void DxfReader::ParsePolyLine()
 {
-	URHO3D_LOGINFO("Parsing polyline...");
+	DXF_LOGDEBUG("Parsing polyline...");
 
-	nextPair = GetNextLinePair();
+	DxfOffset start = groupPosition_;
+	GetNextGroup();
 
-	//get reference to last block
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
+	//header is filled here, the handler gets it before the first vertex and again at the end
+	DxfEntity polyline(DXF_POLYLINE);
+	bool begun = false;
 
-	//write type
-	//(*currBlock)["000_TYPE"] = "Polyline";
+	while (!IsEnd(nextPair_) && !Is(nextPair_, 0, "ENDSEC")) {
 
-	//store polyline line data in variantmap
-	VariantMap polyline;
-	polyline["000_TYPE"] = "POLYLINE";
-	polyline["Vertices"] = VariantVector();
-	polyline["Faces"] = VariantVector();
 
-	while (!IsEnd(nextPair) && !Is(nextPair, 0, "ENDSEC")) {
+		if (Is(nextPair_, 0, "VERTEX")) {
 
+			if (!begun) {
+				if (polyfaceOnly_ && !(polyline.flags_ & DXF_POLYFACE_MESH)) {
+					SkipFiltered(start, true);
+					return;
+				}
 
-		if (Is(nextPair, 0, "VERTEX")) {
+				handler_->OnPolylineBegin(polyline);
+				begun = true;
+			}
 
 			ParsePolyLineVertex(polyline);
 
 			//not exactly sure what to do here...
-			if (Is(nextPair, 0, "SEQEND")) {
+			if (Is(nextPair_, 0, "SEQEND")) {
 				break;
 			}
 
@@ -458,75 +1603,94 @@ void DxfReader::ParsePolyLine()
 			continue;
 		}
 
-		switch (nextPair.first_)
+		switch (nextPair_.code_)
 		{
 			// flags --- important that we know whether it is a
 			// polyface mesh or 'just' a line.
 		case 70:
 			
-			polyline["Flags"] = ToUInt(nextPair.second_.GetString());
+			polyline.flags_ = nextPair_.GetUInt();
+			polyline.fields_ |= DXF_FIELD_FLAGS;
 			break;
 
 			// optional number of vertices
 		case 71:
-			polyline["NumVerticesHint"] = ToUInt(nextPair.second_.GetString());
+			polyline.verticesHint_ = nextPair_.GetUInt();
+			polyline.fields_ |= DXF_FIELD_VERTICES_HINT;
 			break;
 
 			// optional number of faces
 		case 72:
-			polyline["NumFacesHint"] = ToUInt(nextPair.second_.GetString());
+			polyline.facesHint_ = nextPair_.GetUInt();
+			polyline.fields_ |= DXF_FIELD_FACES_HINT;
+			break;
+
+			// handle and owner
+		case 5:
+		case 330:
+			ReadHandle();
 			break;
 
 			// 8 specifies the layer on which this line is placed on
 		case 8:
-			polyline["Layer"] = nextPair.second_.GetString();
+			polyline.layer_ = document_->AddLayer(nextPair_.value_, nextPair_.length_);
+			//the layer comes before the first VERTEX, so nothing has reached the handler yet
+			if (!begun && IsFiltered(polyline.layer_)) {
+				SkipFiltered(start, true);
+				return;
+			}
 			break;
 		}
 
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 
-	//if polyline has indices, then it is a mesh. Otherwise it is just a polyline
-	bool hasIndices = polyline["Faces"].GetVariantVector().Size() > 3 ? true : false;
-	if (hasIndices) {
-		meshes_.Push(polyline);
-	}
-	else {
-		polylines_.Push(polyline);
+	if (!begun) {
+		if (polyfaceOnly_ && !(polyline.flags_ & DXF_POLYFACE_MESH)) {
+			++filteredEntities_;
+			filteredBytes_ += groupPosition_ - start;
+			return;
+		}
+
+		handler_->OnPolylineBegin(polyline);
 	}
+
+	//if polyline has indices, then it is a mesh. Otherwise it is just a polyline.
+	//DxfDocument::IsMesh() tells them apart.
+	handler_->OnPolylineEnd(polyline);
 }
 
 void DxfReader::ParsePoint()
 {
-	URHO3D_LOGINFO("Parsing point...");
-
-	nextPair = GetNextLinePair();
+	DXF_LOGDEBUG("Parsing point...");
 
-	//get reference to last block
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
+	DxfOffset start = groupPosition_;
+	GetNextGroup();
 
-	//write type
-	//(*currBlock)["000_TYPE"] = "Polyline";
+	DxfEntity point(DXF_POINT);
 
-	//store polyline line data in variantmap
-	VariantMap point;
-	point["000_TYPE"] = "POINT";
-	point["Position"] = Vector3();
-	point["Layer"] = "Default";
+	DxfVector3d v;
 
-	Vector3 v;
+	while (!IsEnd(nextPair_)) {
 
-	while (!IsEnd(nextPair)) {
-
-		if (nextPair.first_ == 0) { // SEQEND or another VERTEX
+		if (nextPair_.code_ == 0) { // SEQEND or another VERTEX
 			break;
 		}
 
-		switch (nextPair.first_)
+		switch (nextPair_.code_)
 		{
+		case 5:
+		case 330:
+			ReadHandle();
+			break;
+
 		case 8:
-			point["Layer"] = nextPair.second_.ToString();
+			point.layer_ = document_->AddLayer(nextPair_.value_, nextPair_.length_);
+			if (IsFiltered(point.layer_)) {
+				SkipFiltered(start, false);
+				return;
+			}
 			break;
 
 		case 70:
@@ -534,15 +1698,15 @@ void DxfReader::ParsePoint()
 
 			// VERTEX COORDINATES
 		case 10:
-			v.x_ = ToFloat(nextPair.second_.GetString());
+			v.x_ = GetCoordinate();
 			break;
 
 		case 20:
-			v.y_ = ToFloat(nextPair.second_.GetString());
+			v.y_ = GetCoordinate();
 			break;
 
 		case 30:
-			v.z_ = ToFloat(nextPair.second_.GetString());
+			v.z_ = GetCoordinate();
 			break;
 
 			// POLYFACE vertex indices
@@ -554,37 +1718,39 @@ void DxfReader::ParsePoint()
 
 			// color
 		case 62:
-			URHO3D_LOGERROR("Ignoring vertex color...");
+			Warn(DXF_WARNING_VERTEX_COLOR);
 			break;
 		};
 
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 
-	point["Position"] = v;
+	Vector3 local;
+	Localize(&v, &local, 1);
 
-	//push to list
-	points_.Push(point);
+	point.vertexCount_ = 1;
+	handler_->OnPoint(point, local);
 }
 
-void DxfReader::ParsePolyLineVertex(VariantMap& polyline)
+void DxfReader::ParsePolyLineVertex(DxfEntity& polyline)
 {
-	URHO3D_LOGINFO("Parsing polyline vertex...");
+	DXF_LOGDEBUG("Parsing polyline vertex...");
 
-	nextPair = GetNextLinePair();
+	GetNextGroup();
 
 	unsigned int flags = 0;
-	VariantVector indices;
-	Vector3 v;
+	int indices[4];
+	unsigned numIndices = 0;
+	DxfVector3d v;
 
-	while (!IsEnd(nextPair)) {
+	while (!IsEnd(nextPair_)) {
 
-		if (nextPair.first_ == 0) { // SEQEND or another VERTEX
+		if (nextPair_.code_ == 0) { // SEQEND or another VERTEX
 			break;
 		}
 
-		switch (nextPair.first_)
+		switch (nextPair_.code_)
 		{
 		case 8:
 			// layer to which the vertex belongs to - assume that
@@ -593,20 +1759,20 @@ void DxfReader::ParsePolyLineVertex(VariantMap& polyline)
 			break;
 
 		case 70:
-			flags = ToUInt(nextPair.second_.GetString());
+			flags = nextPair_.GetUInt();
 			break;
 
 			// VERTEX COORDINATES
 		case 10: 
-			v.x_ = ToFloat(nextPair.second_.GetString());
+			v.x_ = GetCoordinate();
 			break;
 
 		case 20: 
-			v.y_ = ToFloat(nextPair.second_.GetString());
+			v.y_ = GetCoordinate();
 			break;
 
 		case 30: 
-			v.z_ = ToFloat(nextPair.second_.GetString());
+			v.z_ = GetCoordinate();
 			break;
 
 			// POLYFACE vertex indices
@@ -614,137 +1780,136 @@ void DxfReader::ParsePolyLineVertex(VariantMap& polyline)
 		case 72:
 		case 73:
 		case 74:
-			if (indices.Size() == 4) {
-				URHO3D_LOGERROR("DXF: more than 4 indices per face not supported; ignoring");
+			if (numIndices == 4) {
+				Warn(DXF_WARNING_FACE_INDICES);
 				break;
 			}
-			indices.Push(ToUInt(nextPair.second_.GetString()));
+			//negative indices mark invisible edges
+			indices[numIndices++] = nextPair_.GetInt();
 			break;
 
 			// color
 		case 62:
-			URHO3D_LOGERROR("Ignoring vertex color...");
+			Warn(DXF_WARNING_VERTEX_COLOR);
 			break;
 		};
 
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 
-	//add to vertex list
-	VariantVector* verts = polyline["Vertices"].GetVariantVectorPtr();
-	assert(verts);
-	verts->Push(v);
+	Vector3 local;
+	Localize(&v, &local, 1);
 
-	//add to face list
-	VariantVector* faces = polyline["Faces"].GetVariantVectorPtr();
-	assert(faces);
-	faces->Push(indices);
+	handler_->OnPolylineVertex(polyline, local, indices, numIndices);
+	++polyline.vertexCount_;
+	polyline.indexCount_ += numIndices;
 }
 
 void DxfReader::Parse3DFace()
 {
-	URHO3D_LOGINFO("Parsing 3D face...");
+	DXF_LOGDEBUG("Parsing 3D face...");
 
-	nextPair = GetNextLinePair();
+	DxfOffset start = groupPosition_;
+	GetNextGroup();
 
-	//get reference to last block
-	VariantMap* currBlock = blocks_.Back().GetVariantMapPtr();
-
-	//store polyline line data in variantmap
-	VariantMap polyline;
-	polyline["000_TYPE"] = "3DFACE";
-	polyline["Vertices"] = VariantVector();
-	polyline["Faces"] = VariantVector();
+	DxfEntity face(DXF_3DFACE);
 
 	//some data
-	Vector3 vip[4];
-	Color clr = Color::BLACK;
+	DxfVector3d vip[4];
 	bool b[4] = { false,false,false,false };
 
-	while (!IsEnd(nextPair)) {
+	while (!IsEnd(nextPair_)) {
 
 		// next entity with a groupcode == 0 is probably already the next vertex or polymesh entity
-		if (nextPair.first_ == 0) {
+		if (nextPair_.code_ == 0) {
 			break;
 		}
-		switch (nextPair.first_)
+		switch (nextPair_.code_)
 		{
+			// handle and owner
+		case 5:
+		case 330:
+			ReadHandle();
+			break;
 
 			// 8 specifies the layer
 		case 8:
-			polyline["Layer"] = nextPair.second_.GetString();
+			face.layer_ = document_->AddLayer(nextPair_.value_, nextPair_.length_);
+			if (IsFiltered(face.layer_)) {
+				SkipFiltered(start, false);
+				return;
+			}
 			break;
-
 			// x position of the first corner
 		case 10: 
-			vip[0].x_ = ToFloat(nextPair.second_.GetString());
+			vip[0].x_ = GetCoordinate();
 			b[2] = true;
 			break;
 
 			// y position of the first corner
 		case 20: 
-			vip[0].y_ = ToFloat(nextPair.second_.GetString());
+			vip[0].y_ = GetCoordinate();
 			b[2] = true;
 			break;
 
 			// z position of the first corner
 		case 30: 
-			vip[0].z_ = ToFloat(nextPair.second_.GetString());
+			vip[0].z_ = GetCoordinate();
 			b[2] = true;
 			break;
 
 			// x position of the second corner
 		case 11: 
-			vip[1].x_ = ToFloat(nextPair.second_.GetString());
+			vip[1].x_ = GetCoordinate();
 			b[3] = true;
 			break;
 
 			// y position of the second corner
 		case 21: 
-			vip[1].y_ = ToFloat(nextPair.second_.GetString());
+			vip[1].y_ = GetCoordinate();
 			b[3] = true;
 			break;
 
 			// z position of the second corner
 		case 31: 
-			vip[1].z_ = ToFloat(nextPair.second_.GetString());
+			vip[1].z_ = GetCoordinate();
 			b[3] = true;
 			break;
 
 			// x position of the third corner
 		case 12:
-			vip[2].x_ = ToFloat(nextPair.second_.GetString());
+			vip[2].x_ = GetCoordinate();
 			b[0] = true;
 			break;
 
 			// y position of the third corner
 		case 22: 
-			vip[2].y_ = ToFloat(nextPair.second_.GetString());
+			vip[2].y_ = GetCoordinate();
 			b[0] = true;
 			break;
 
 			// z position of the third corner
 		case 32: 
-			vip[2].z_ = ToFloat(nextPair.second_.GetString());
+			vip[2].z_ = GetCoordinate();
 			b[0] = true;
 			break;
 
 			// x position of the fourth corner
 		case 13: 
-			vip[3].x_ = ToFloat(nextPair.second_.GetString());
+			vip[3].x_ = GetCoordinate();
 			b[1] = true;
 			break;
 
 			// y position of the fourth corner
 		case 23: 
-			vip[3].y_ = ToFloat(nextPair.second_.GetString());
+			vip[3].y_ = GetCoordinate();
 			b[1] = true;
 			break;
 
 			// z position of the fourth corner
 		case 33: 
-			vip[3].z_ = ToFloat(nextPair.second_.GetString());
+			vip[3].z_ = GetCoordinate();
 			b[1] = true;
 			break;
 
@@ -754,24 +1919,16 @@ void DxfReader::Parse3DFace()
 		};
 
 		//recurse
-		nextPair = GetNextLinePair();
+		GetNextGroup();
 	}
 
-	//fill the data
-	VariantVector pVerts;
-	pVerts.Resize(4);
-
-	for (int i = 0; i < 4; i++)
-	{
-		pVerts[i] = vip[i];
+	if (b[0]) {
+		face.fields_ |= DXF_FIELD_THIRD_CORNER;
 	}
 
-	polyline["Vertices"] = pVerts;
+	Vector3 corners[4];
+	Localize(vip, corners, 4);
 
-	//push to list
-	polylines_.Push(polyline);
+	face.vertexCount_ = 4;
+	handler_->On3DFace(face, corners);
 }
-
-
-
-
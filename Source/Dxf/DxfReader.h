@@ -1,22 +1,85 @@
 #include "Core/Context.h"
 #include "Core/Object.h"
+#include "Container/HashMap.h"
+#include "Container/HashSet.h"
 #include "Container/Vector.h"
 #include "Container/Str.h"
 #include "Core/Variant.h"
+#include "Core/WorkQueue.h"
 #include "IO/Deserializer.h"
 #include "IO/File.h"
 #include "IO/FileSystem.h"
+#include "IO/Log.h"
+#include "DxfBoundsQuery.h"
+#include "DxfCache.h"
+#include "DxfDocument.h"
+#include "DxfHandleIndex.h"
+#include "DxfTokenizer.h"
 
 using namespace Urho3D;
 
 typedef Pair<int, Variant> LinePair;
 
+class DxfReader;
+
+//parses one entity. It is called at the 0 group that names the entity and must stop at the next 0 group.
+typedef void (*DxfEntityParser)(DxfReader& reader);
+
+//decides whether the entities on a layer are read, see DxfReader::SetLayerPredicate()
+typedef bool (*DxfLayerPredicate)(const String& layer, void* userData);
+
+//a registered parser, with its name to rule out hash collisions
+struct DxfEntityParserEntry
+{
+	String name_;
+	DxfEntityParser parser_;
+};
+
+//parallel parsing splits the ENTITIES section into chunks of about this many bytes
+static const unsigned DXF_DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
+//of the files SaveBoundsIndex() writes
+static const unsigned DXF_BOUNDS_VERSION = 2;
+
+//parser messages below this level are compiled out. Per-entity progress is LOG_DEBUG.
+#ifndef DXF_LOG_LEVEL
+#define DXF_LOG_LEVEL Urho3D::LOG_INFO
+#endif
+
+//a SECTION found by the index. Offsets are in bytes from the start of the file.
+struct DxfSection
+{
+	DxfSection() :
+		start_(0),
+		end_(DXF_NO_OFFSET),
+		parsed_(false)
+	{
+	}
+
+	String name_;
+	//the group after the 2/name group
+	DxfOffset start_;
+	//the 0/ENDSEC group, DXF_NO_OFFSET if the section is not closed (yet)
+	DxfOffset end_;
+	bool parsed_;
+};
+
+//problems that can repeat for every entity. They are counted, and reported once at the end of Parse().
+enum DxfWarning
+{
+	DXF_WARNING_VERTEX_COLOR = 0,
+	DXF_WARNING_FACE_INDICES,
+	MAX_DXF_WARNINGS
+};
+
 URHO3D_API class DxfReader : public Object
 {
 	URHO3D_OBJECT(DxfReader, Object);
 
 public:
 	DxfReader(Context* context, String path);
+	//read from a buffer in memory. It is not copied, so it must outlive the reader.
+	//LZ4 frames (.dxf.lz4, see DxfCompression.h) are recognized in both and expanded first.
+	DxfReader(Context* context, const char* data, DxfOffset size);
 	~DxfReader() {};
 
 	/**************************************************************************
@@ -28,52 +91,346 @@ public:
 
 	This is the most basic example, other codes have more complex values.
 	Therefore, we define a method that reads in pairs of lines.
+
+	GetNextGroup() is what the parsers use: it returns a view into the file
+	buffer and does not allocate. GetNextLinePair() copies the value into a Variant.
 	***************************************************************************/
+	const DxfGroup& GetNextGroup();
 	LinePair GetNextLinePair();
 
 	//main loop for parsing
 	bool Parse();
 
+	//stream entities to a handler instead of keeping them in the document. The handler is not
+	//owned and must outlive Parse(); null goes back to the document. Layers, blocks and
+	//insertions are still kept in the document. Streaming parses serially.
+	void SetEntityHandler(DxfEntityHandler* handler);
+	DxfEntityHandler* GetEntityHandler() const { return handler_; }
+
+	/**************************************************************************
+	Lazy parsing. Instead of Parse(), a caller can go straight to what it needs:
+	 ---- ParseSection("HEADER")   <- eg. just the extents
+	 ---- ParseBlockAt(i)          <- one BLOCK definition
+	 ---- ParseEntityAt(i)         <- one top-level entity of ENTITIES
+
+	The index behind these is a scan of the group codes that records where
+	sections, blocks and entities start. It is built as far as needed and no
+	further, so asking for the header only looks at the bytes of the header.
+	Each part is parsed once; asking again does nothing. Don't mix with Parse().
+	Parse() resolves INSERTs at the end; after lazy parsing, call
+	DxfDocument::ResolveInsertions() once the blocks are in.
+	***************************************************************************/
+	bool ParseSection(const String& name);
+	bool ParseBlockAt(unsigned index);
+	bool ParseEntityAt(unsigned index);
+	//index the whole file
+	void BuildIndex();
+	//sections indexed so far
+	const Vector<DxfSection>& GetSections() const { return sections_; }
+	//the file (or buffer) being read
+	const DxfTokenizer& GetTokenizer() const { return tokenizer_; }
+	const DxfSection* GetSection(const String& name);
+	unsigned GetNumBlocks();
+	unsigned GetNumEntities();
+	const PODVector<DxfOffset>& GetBlockOffsets() { Index("BLOCKS"); return blockOffsets_; }
+	const PODVector<DxfOffset>& GetEntityOffsets() { Index("ENTITIES"); return entityOffsets_; }
+
+	/**************************************************************************
+	Coordinates are read in double precision. Before they are stored as
+	floats, the origin is subtracted, so survey coordinates (6-7 digit
+	eastings) keep their millimetres in a local frame:
+	 ---- SetOrigin()                <- a fixed origin
+	 ---- SetAutoOrigin()            <- $EXTMIN of the header, or else the first position, in whole units
+	 ---- SetPreciseCoordinates()    <- also keep the unshifted doubles (OnPrecisePositions())
+	The origin ends up in the document. Entities inside BLOCK definitions
+	and block base points are in block coordinates and are not shifted;
+	INSERT positions are.
+	***************************************************************************/
+	void SetOrigin(const DxfVector3d& origin);
+	void SetAutoOrigin(bool enable) { autoOrigin_ = enable; }
+	void SetPreciseCoordinates(bool enable) { precise_ = enable; }
+	bool GetPreciseCoordinates() const { return precise_; }
+
+	//runtime log level of the parser, LOG_INFO by default. Only matters down to DXF_LOG_LEVEL.
+	void SetLogLevel(int level) { logLevel_ = level; }
+	int GetLogLevel() const { return logLevel_; }
+	//how often a warning came up in the last Parse()
+	unsigned GetWarningCount(DxfWarning warning) const { return warnings_[warning]; }
+
+	//count the entities, vertices and face indices of the ENTITIES section in a quick scan first, and
+	//reserve the document's arrays for them. Without it only the POLYLINE count hints are used.
+	void SetPrecount(bool enable) { precount_ = enable; }
+	bool GetPrecount() const { return precount_; }
+
+	/**************************************************************************
+	Layer filter. Entities of the ENTITIES section on a rejected layer are
+	skipped as soon as their layer (code 8) is read: the rest of their groups
+	are not parsed, no vertices are made, and the handler never sees them.
+	 ---- SetLayerFilter(layers, true)        <- only these layers
+	 ---- SetLayerFilter(layers, false)       <- all but these layers
+	 ---- SetLayerPredicate(fn, userData)     <- let a function decide
+	Each layer is decided once per reader; with SetParallel() the predicate
+	is also called from the worker threads. INSERTs and the contents of BLOCK
+	definitions are kept: block entities usually sit on layer 0 and show on
+	the layer of their INSERT.
+	***************************************************************************/
+	void SetLayerFilter(const Vector<String>& layers, bool include = true);
+	void SetLayerPredicate(DxfLayerPredicate predicate, void* userData = 0);
+	void ClearLayerFilter();
+	//entities skipped by the layer filter and the entity selection, and the bytes they took up
+	unsigned GetNumFilteredEntities() const { return filteredEntities_; }
+	DxfOffset GetFilteredBytes() const { return filteredBytes_; }
+
+	/**************************************************************************
+	Entity selection. Only the named entities of the ENTITIES section are
+	parsed, eg. just POINT for a point cloud. The others are skipped by the
+	tokenizer, which looks for the next 0 group without converting anything
+	(see DxfTokenizer::NextEntity()); a POLYLINE goes with its VERTEXes.
+	SetPolyfaceOnly() also drops POLYLINEs that are not polyface meshes,
+	once their flags are read. Skipped entities count as filtered.
+	***************************************************************************/
+	void SetEntitySelection(const Vector<String>& names);
+	void ClearEntitySelection();
+	void SetPolyfaceOnly(bool enable) { polyfaceOnly_ = enable; }
+
+	/**************************************************************************
+	Spatial query. Only the entities of the ENTITIES section whose bounds
+	meet the region reach the document (or handler); the others are dropped
+	once their positions are read, and polylines are held back until SEQEND
+	for that. The region is in the document's coordinates, ie. after the
+	origin shift. INSERTs and entities without positions are kept.
+	 ---- SetQueryBox(box)
+	 ---- SetQueryFrustum(frustum)
+
+	While a query is set, or with SetRecordBounds(), Parse() records the
+	bounds of every top-level entity. SaveBoundsIndex() keeps them next to
+	the file; a reader of the same file that loads them with
+	LoadBoundsIndex() seeks straight to the entities that meet its query,
+	and parses nothing else of ENTITIES. The index is only used when the
+	file's size, modification time and content hash, and the origin, match
+	the ones it was made with.
+	***************************************************************************/
+	void SetQueryBox(const BoundingBox& box) { query_.SetBox(box); }
+	void SetQueryFrustum(const Frustum& frustum) { query_.SetFrustum(frustum); }
+	void ClearQuery() { query_.Clear(); }
+	void SetRecordBounds(bool enable) { recordBounds_ = enable; }
+	//entities dropped by the query in the last Parse()
+	unsigned GetNumCulledEntities() const { return culledEntities_; }
+	const PODVector<DxfEntityBounds>& GetEntityBounds() const { return entityBounds_; }
+	bool SaveBoundsIndex(const String& path);
+	bool LoadBoundsIndex(const String& path);
+	bool HasBoundsIndex() const { return boundsLoaded_; }
+
+	/**************************************************************************
+	Parse cache. With a cache directory, Parse() first looks there for a
+	blob of the file (see DxfCache.h) and takes the document from it; if
+	there is none, or the file changed, it parses and writes one. Blobs are
+	named after the path of the file, or the content of a buffer, and keyed
+	by size, modification time, content hash and the origin settings.
+	Only whole documents are cached: a parse with a layer filter, an entity
+	selection, a query, an entity handler, the handle index or a parser of
+	its own (RegisterEntityParser()) neither reads nor writes it.
+	***************************************************************************/
+	void SetCacheDirectory(const String& directory, bool compress = false);
+	//whether the last Parse() took the document from the cache
+	bool IsFromCache() const { return fromCache_; }
+
+	/**************************************************************************
+	Handle index. With SetHandleIndex(true) the parsers record the handle
+	(code 5) and owner (code 330) of every entity, with its place in the
+	document and its offset in the file (see DxfHandleIndex). Entities that
+	are not kept, eg. filtered or streamed ones, only have the offset.
+	Lazy parsing records them too: the index scan takes the handles of the
+	ENTITIES section without parsing, and ParseEntityByHandle() parses the
+	one entity a handle names. Where an entity has more than one 330
+	group (persistent reactors first), the last one is the owner.
+	Custom parsers call ReadHandle() at both codes to take part.
+	***************************************************************************/
+	void SetHandleIndex(bool enable) { handleIndex_ = enable; }
+	const DxfHandleIndex& GetHandleIndex() const { return handles_; }
+	bool ParseEntityByHandle(const String& handle);
+	void ReadHandle();
+
+	//parse the ENTITIES section in chunks on the WorkQueue threads. The result is the same as a serial parse.
+	void SetParallel(bool enable, unsigned chunkSize = DXF_DEFAULT_CHUNK_SIZE);
+	bool IsParallel() const { return parallel_; }
+
+	//entity dispatch. The built-in parsers are registered up front; registering a name again
+	//replaces its parser, and a null parser removes it so the entity is skipped.
+	void RegisterEntityParser(const String& name, DxfEntityParser parser);
+	DxfEntityParser GetEntityParser(const DxfGroup& group) const;
+
 	//individual parsers
 	void SkipSection();
+	void SkipEntity();
 	void ParseHeader();
 	void ParseEntities();
+	void ParseEntityRange(DxfOffset end);
+	//run by the worker threads on chunk readers
+	void ParseEntityChunk();
 	void ParseBlocks();
 	void ParseBlock();
 	void ParseInsertion();
 	void ParsePolyLine();
 	void ParseLWPolyLine();
-	void ParsePolyLineVertex(VariantMap& polyline);
+	void ParsePolyLineVertex(DxfEntity& polyline);
 	void ParsePoint();
 	void Parse3DFace();
 
 	//some helpers
+	bool Is(const DxfGroup& group, int code, const char* name);
 	bool Is(LinePair pair, int code, String name);
+	bool IsEnd(const DxfGroup& group);
 	bool IsEnd(LinePair pair);
 	bool IsType(LinePair pair, int code, VariantType type);
 
-	//getters
-	VariantVector GetBlocks() { return blocks_; };
-	VariantVector GetInsertions() { return insertions_; };
-	VariantVector GetMeshes() { return meshes_; };
-	VariantVector GetPolylines() { return polylines_; };
-	VariantVector GetPoints() { return points_; };
+	//typed result of the parse
+	DxfDocument* GetDocument() const { return document_; }
+
+	//getters. These build the old VariantMap layout from the document on every call.
+	VariantVector GetBlocks() { return document_->ToVariantBlocks(); };
+	VariantVector GetInsertions() { return document_->ToVariantInsertions(); };
+	VariantVector GetMeshes() { return document_->ToVariantMeshes(); };
+	VariantVector GetPolylines() { return document_->ToVariantPolylines(); };
+	VariantVector GetPoints() { return document_->ToVariantPoints(); };
 
 protected:
 
+	//chunk reader sharing the buffer of the tokenizer, for [start, end) of the ENTITIES section.
+	//It initializes every member; the public constructors delegate to it.
+	DxfReader(Context* context, const DxfTokenizer& tokenizer, DxfOffset start, DxfOffset end);
+
+	void RegisterDefaultEntityParsers();
+	//read the value of a coordinate group
+	double GetCoordinate() const { return nextPair_.GetDouble(); }
+	void ResolveAutoOrigin(const DxfVector3d& fallback);
+	//reserve the document for the ENTITIES section ahead
+	void PrecountEntities();
+	//move positions into the local frame, and pass the precise ones on
+	void Localize(const DxfVector3d* positions, Vector3* local, unsigned count);
+	//only move them, for positions that are not vertices
+	void Shift(const DxfVector3d* positions, Vector3* local, unsigned count);
+	//extend the index until the named section is closed, or to the end for null
+	void Index(const char* until);
+	DxfSection* FindSection(const String& name);
+	void Warn(DxfWarning warning) { ++warnings_[warning]; }
+	//whether the layer filter drops the entities of a layer. Only top-level entities are filtered.
+	bool IsFiltered(unsigned layer);
+	//skip the rest of a filtered entity that started at start; a POLYLINE up to its SEQEND
+	void SkipFiltered(DxfOffset start, bool polyline);
+	//whether the entity named by a 0 group is selected
+	bool IsSelected(const DxfGroup& group) const;
+	//skip an entity that was not selected, from its 0 group to the next entity
+	void SkipUnselected();
+	void ReportWarnings();
+	bool ParseEntitiesParallel();
+	//parse the entities of a loaded bounds index that meet the query
+	bool ParseEntitiesIndexed();
+	//run an entity parser, and record its handle
+	void RunEntityParser(DxfEntityParser parser);
+	//whether Parse() makes a whole document, which is what the cache keeps
+	bool IsCacheable() const;
+	//the source alone: size, modification time and content hash
+	DxfCacheKey GetSourceKey() const;
+	DxfCacheKey GetCacheKey() const;
+	String GetCachePath(const DxfCacheKey& key) const;
+	WorkQueue* GetWorkQueue();
+
+	//the file, empty for a buffer
+	String path_;
+	//splits the mapped file (or buffer) into groups
+	DxfTokenizer tokenizer_;
+	//the group the parsers are looking at, and where it starts
+	DxfGroup nextPair_;
+	DxfOffset groupPosition_;
+
+	//parallel parsing
+	bool parallel_;
+	unsigned chunkSize_;
+	DxfOffset chunkStart_;
+	DxfOffset chunkEnd_;
+
+	//chunk readers don't log, their warnings are counted by the parent
+	int logLevel_;
+	unsigned warnings_[MAX_DXF_WARNINGS];
+
+	//preallocation
+	bool precount_;
+
+	//coordinates
+	bool precise_;
+	bool autoOrigin_;
+	bool originResolved_;
+	DxfVector3d origin_;
+	//the BLOCK definition being parsed, where coordinates are not shifted. DXF_NO_BLOCK outside.
+	unsigned currentBlock_;
+
+	//layer filter, see SetLayerFilter()
+	bool layerFilter_;
+	HashSet<String> filterLayers_;
+	bool filterInclude_;
+	DxfLayerPredicate layerPredicate_;
+	void* layerPredicateData_;
+	//per layer id of the document: 0 until decided, then 1 to read or 2 to skip
+	PODVector<unsigned char> layerDecisions_;
+	unsigned filteredEntities_;
+	DxfOffset filteredBytes_;
+	//entity selection, see SetEntitySelection()
+	bool typeFilter_;
+	HashMap<StringHash, String> selectedTypes_;
+	bool polyfaceOnly_;
+
+	//spatial query, see SetQueryBox()
+	DxfBoundsQuery query_;
+	bool recordBounds_;
+	unsigned culledEntities_;
+	//bounds of the top-level entities, and where ENTITIES ends (its 0/ENDSEC group)
+	PODVector<DxfEntityBounds> entityBounds_;
+	DxfOffset entitiesEnd_;
+	//what the bounds were made with: the file and the origin
+	DxfCacheKey boundsKey_;
+	DxfVector3d boundsOrigin_;
+	Vector<String> boundsLayers_;
+	bool boundsLoaded_;
+
+	//parse cache, see SetCacheDirectory()
+	String cacheDirectory_;
+	bool cacheCompress_;
+	bool fromCache_;
+
+	//handle index, see SetHandleIndex(). The handle and owner of the entity being parsed.
+	bool handleIndex_;
+	DxfHandleIndex handles_;
+	unsigned long long entityHandle_;
+	unsigned long long entityOwner_;
+
+	//lazy parsing: the index so far, where its scan stopped, and what was parsed
+	Vector<DxfSection> sections_;
+	PODVector<DxfOffset> blockOffsets_;
+	PODVector<DxfOffset> entityOffsets_;
+	PODVector<bool> blockParsed_;
+	PODVector<bool> entityParsed_;
+	DxfOffset indexPosition_;
+	unsigned indexSection_;
+	bool indexInPolyline_;
+	bool indexComplete_;
+
+	//entity parsers by the hash of the entity name, and whether they are other than the built-in ones
+	HashMap<StringHash, DxfEntityParserEntry> entityParsers_;
+	bool customParsers_;
+
+	//Everything we parse goes here: the things we want (meshes, polylines, points)
+	//as well as blocks and insertions.
+	//
 	//Blocks are logical chunks of a drawing (dxf) file.
 	//Often, they just define base points for model space, paper space by specifying a base point, scale.
 	//However, they CAN have entitites (i.e. polylines, points, etc) embedded in them. I have not seen this in any test files,
 	//but it is allowed. We don't support it currently.
-	VariantVector blocks_;
-
+	//
 	//Insertions seem to be a short way to specify an instance of an entity with pos,rot, and scale.
 	//I think they are appended to entities (or blocks) but I am not sure. I haven't seen one yet.
-	VariantVector insertions_;
-
-	//These are the things we want. 
-	VariantVector meshes_;
-	VariantVector polylines_;
-	VariantVector points_;
+	SharedPtr<DxfDocument> document_;
+	//receives the entities; the document unless SetEntityHandler() was called
+	DxfEntityHandler* handler_;
 
 };
\ No newline at end of file
@@ -0,0 +1,435 @@
+#include "DxfTokenizer.h"
+#include "DxfCompression.h"
+#include "DxfNumber.h"
+
+#include <cstring>
+
+namespace
+{
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	//group codes are short decimal integers
+	inline int ParseCode(const char* start, unsigned length)
+	{
+		const char* end = start + length;
+		bool negative = false;
+
+		if (start < end && (*start == '-' || *start == '+'))
+		{
+			negative = *start == '-';
+			++start;
+		}
+
+		int code = 0;
+		while (start < end && *start >= '0' && *start <= '9')
+		{
+			code = code * 10 + (*start - '0');
+			++start;
+		}
+
+		return negative ? -code : code;
+	}
+
+	//binary values are little-endian and unaligned, like the host
+	template <class T> inline T ReadBinary(const char* data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	//size of a fixed size binary value, 0 for the others
+	inline unsigned GetBinaryValueSize(DxfValueType type)
+	{
+		switch (type)
+		{
+		case DXF_VALUE_DOUBLE: return 8;
+		case DXF_VALUE_INT16: return 2;
+		case DXF_VALUE_INT32: return 4;
+		case DXF_VALUE_INT64: return 8;
+		case DXF_VALUE_BOOL: return 1;
+		default: return 0;
+		}
+	}
+}
+
+bool DxfGroup::Equals(const char* value) const
+{
+	for (unsigned i = 0; i < length_; ++i)
+	{
+		if (value[i] != value_[i])
+			return false;
+	}
+
+	return value[length_] == 0;
+}
+
+String DxfGroup::GetString() const
+{
+	switch (type_)
+	{
+	case DXF_VALUE_DOUBLE: return String(GetDouble());
+	case DXF_VALUE_INT16:
+	case DXF_VALUE_INT32:
+	case DXF_VALUE_BOOL: return String(GetInt());
+	case DXF_VALUE_INT64: return String(ReadBinary<long long>(value_));
+	default: return String(value_, length_);
+	}
+}
+
+float DxfGroup::GetFloat() const
+{
+	return (float)GetDouble();
+}
+
+double DxfGroup::GetDouble() const
+{
+	switch (type_)
+	{
+	case DXF_VALUE_DOUBLE: return ReadBinary<double>(value_);
+	case DXF_VALUE_INT16:
+	case DXF_VALUE_INT32:
+	case DXF_VALUE_BOOL: return GetInt();
+	case DXF_VALUE_INT64: return (double)ReadBinary<long long>(value_);
+	default: return DxfToDouble(value_, length_);
+	}
+}
+
+int DxfGroup::GetInt() const
+{
+	switch (type_)
+	{
+	case DXF_VALUE_DOUBLE: return (int)ReadBinary<double>(value_);
+	case DXF_VALUE_INT16: return ReadBinary<short>(value_);
+	case DXF_VALUE_INT32: return ReadBinary<int>(value_);
+	case DXF_VALUE_INT64: return (int)ReadBinary<long long>(value_);
+	case DXF_VALUE_BOOL: return (unsigned char)*value_;
+	default: return DxfToInt(value_, length_);
+	}
+}
+
+unsigned DxfGroup::GetUInt() const
+{
+	if (type_ != DXF_VALUE_TEXT)
+		return (unsigned)GetInt();
+
+	return DxfToUInt(value_, length_);
+}
+
+DxfTokenizer::DxfTokenizer() :
+	begin_(0),
+	end_(0),
+	cursor_(0),
+	lineBreak_('\n'),
+	binary_(false),
+	codeSize_(2),
+	lineNumber_(0)
+{
+}
+
+bool DxfTokenizer::Open(const String& path, WorkQueue* queue)
+{
+	expanded_.Reset();
+	file_ = new MappedFile(path);
+
+	if (!file_->IsOpen())
+	{
+		file_.Reset();
+		SetBuffer(0, 0);
+		return false;
+	}
+
+	if (IsDxfCompressed(file_->GetData(), file_->GetSize()))
+	{
+		//the mapping is not needed once the file is expanded
+		SharedPtr<MappedFile> file = file_;
+		file_.Reset();
+		return SetCompressedBuffer((const char*)file->GetData(), file->GetSize(), queue);
+	}
+
+	SetBuffer((const char*)file_->GetData(), file_->GetSize());
+	return true;
+}
+
+bool DxfTokenizer::SetCompressedBuffer(const char* data, DxfOffset size, WorkQueue* queue)
+{
+	DxfOffset expandedSize = 0;
+
+	if (!DecompressDxf(data, size, expanded_, expandedSize, queue))
+	{
+		expanded_.Reset();
+		SetBuffer(0, 0);
+		return false;
+	}
+
+	SetBuffer(expanded_.Get(), expandedSize);
+	return true;
+}
+
+void DxfTokenizer::SetBuffer(const char* data, DxfOffset size)
+{
+	begin_ = data;
+	end_ = data + (size_t)size;
+	cursor_ = data;
+	lineNumber_ = 0;
+
+	binary_ = size >= DXF_BINARY_SENTINEL_LENGTH && !memcmp(data, DXF_BINARY_SENTINEL, DXF_BINARY_SENTINEL_LENGTH);
+	if (binary_)
+	{
+		//the first group is 0/SECTION. R12 writes its code as one byte, so the text follows at once.
+		cursor_ = begin_ + DXF_BINARY_SENTINEL_LENGTH;
+		codeSize_ = cursor_ + 1 < end_ && cursor_[1] == 'S' ? 1 : 2;
+		return;
+	}
+
+	//look at the first line break to tell bare CR files apart from LF and CRLF ones
+	lineBreak_ = '\n';
+	for (const char* c = begin_; c < end_; ++c)
+	{
+		if (*c == '\n')
+			break;
+		if (*c == '\r')
+		{
+			if (c + 1 < end_ && c[1] != '\n')
+				lineBreak_ = '\r';
+			break;
+		}
+	}
+}
+
+void DxfTokenizer::Seek(DxfOffset position)
+{
+	//never back into the sentinel of a binary file
+	if (binary_ && position < DXF_BINARY_SENTINEL_LENGTH)
+		position = DXF_BINARY_SENTINEL_LENGTH;
+
+	cursor_ = begin_ + (size_t)(position < GetSize() ? position : GetSize());
+}
+
+void DxfTokenizer::ReadLine(const char*& start, unsigned& length)
+{
+	const char* lineStart = cursor_;
+	const char* lineEnd = (const char*)memchr(cursor_, lineBreak_, end_ - cursor_);
+
+	if (lineEnd)
+	{
+		cursor_ = lineEnd + 1;
+
+		//swallow the other half of a CRLF pair
+		if (lineBreak_ == '\n')
+		{
+			if (lineEnd > lineStart && lineEnd[-1] == '\r')
+				--lineEnd;
+		}
+		else if (cursor_ < end_ && *cursor_ == '\n')
+			++cursor_;
+	}
+	else
+	{
+		lineEnd = end_;
+		cursor_ = end_;
+	}
+
+	while (lineStart < lineEnd && IsBlank(*lineStart))
+		++lineStart;
+	while (lineEnd > lineStart && IsBlank(lineEnd[-1]))
+		--lineEnd;
+
+	start = lineStart;
+	length = (unsigned)(lineEnd - lineStart);
+}
+
+DxfValueType DxfTokenizer::GetBinaryValueType(int code)
+{
+	if (code < 10)
+		return DXF_VALUE_TEXT;
+	if (code < 60)
+		return DXF_VALUE_DOUBLE;
+	if (code < 80)
+		return DXF_VALUE_INT16;
+	if (code >= 90 && code < 100)
+		return DXF_VALUE_INT32;
+	if (code >= 110 && code < 150)
+		return DXF_VALUE_DOUBLE;
+	if (code >= 160 && code < 170)
+		return DXF_VALUE_INT64;
+	if (code >= 170 && code < 180)
+		return DXF_VALUE_INT16;
+	if (code >= 210 && code < 240)
+		return DXF_VALUE_DOUBLE;
+	if (code >= 270 && code < 290)
+		return DXF_VALUE_INT16;
+	if (code >= 290 && code < 300)
+		return DXF_VALUE_BOOL;
+	if (code >= 310 && code < 320)
+		return DXF_VALUE_BINARY;
+	if (code >= 370 && code < 390)
+		return DXF_VALUE_INT16;
+	if (code >= 400 && code < 410)
+		return DXF_VALUE_INT16;
+	if (code >= 420 && code < 430)
+		return DXF_VALUE_INT32;
+	if (code >= 440 && code < 460)
+		return DXF_VALUE_INT32;
+	if (code >= 460 && code < 470)
+		return DXF_VALUE_DOUBLE;
+	if (code == 1004)
+		return DXF_VALUE_BINARY;
+	if (code >= 1010 && code < 1060)
+		return DXF_VALUE_DOUBLE;
+	if (code >= 1060 && code < 1071)
+		return DXF_VALUE_INT16;
+	if (code == 1071)
+		return DXF_VALUE_INT32;
+
+	return DXF_VALUE_TEXT;
+}
+
+bool DxfTokenizer::NextBinary(DxfGroup& group)
+{
+	//read the code
+	size_t available = (size_t)(end_ - cursor_);
+	if (codeSize_ == 1 && (unsigned char)*cursor_ != 255)
+	{
+		group.code_ = (unsigned char)*cursor_;
+		++cursor_;
+	}
+	else
+	{
+		//R12 escapes codes above 254 with a 255 byte
+		unsigned skip = codeSize_ == 1 ? 1 : 0;
+		if (available < skip + 2)
+		{
+			cursor_ = end_;
+			return false;
+		}
+		group.code_ = ReadBinary<short>(cursor_ + skip);
+		cursor_ += skip + 2;
+	}
+
+	//read the value
+	DxfValueType type = GetBinaryValueType(group.code_);
+	const char* value = cursor_;
+	unsigned length = 0;
+
+	available = (size_t)(end_ - cursor_);
+	if (type == DXF_VALUE_TEXT)
+	{
+		const char* terminator = (const char*)memchr(cursor_, 0, available);
+		length = (unsigned)(terminator ? terminator - cursor_ : available);
+		cursor_ += terminator ? length + 1 : length;
+	}
+	else if (type == DXF_VALUE_BINARY)
+	{
+		length = available ? (unsigned char)*cursor_ : 0;
+		++value;
+		if (length + 1 > available)
+		{
+			cursor_ = end_;
+			return false;
+		}
+		cursor_ += length + 1;
+	}
+	else
+	{
+		length = GetBinaryValueSize(type);
+		if (length > available)
+		{
+			cursor_ = end_;
+			return false;
+		}
+		cursor_ += length;
+	}
+
+	group.value_ = value;
+	group.length_ = length;
+	group.type_ = type;
+
+	//there are no lines; count as if there were, so the number still tells groups apart
+	lineNumber_ += 2;
+
+	return true;
+}
+
+bool DxfTokenizer::NextEntity(DxfGroup& group, DxfOffset& position)
+{
+	if (binary_)
+	{
+		while (!IsEof())
+		{
+			position = GetPosition();
+			if (!Next(group))
+				return false;
+			if (group.code_ == 0)
+				return true;
+		}
+		return false;
+	}
+
+	//code and value lines alternate, so a value of 0 is never taken for a code
+	while (!IsEof())
+	{
+		const char* start = cursor_;
+		const char* code;
+		unsigned codeLength;
+		ReadLine(code, codeLength);
+
+		if (codeLength == 1 && *code == '0')
+		{
+			cursor_ = start;
+			position = GetPosition();
+			return Next(group);
+		}
+
+		const char* value;
+		unsigned valueLength;
+		ReadLine(value, valueLength);
+		lineNumber_ += 2;
+	}
+
+	group.code_ = DXF_INVALID_CODE;
+	group.value_ = "";
+	group.length_ = 0;
+	group.type_ = DXF_VALUE_TEXT;
+	return false;
+}
+
+bool DxfTokenizer::Next(DxfGroup& group)
+{
+	group.code_ = DXF_INVALID_CODE;
+	group.value_ = "";
+	group.length_ = 0;
+	group.type_ = DXF_VALUE_TEXT;
+
+	if (IsEof())
+		return false;
+
+	if (binary_)
+	{
+		if (NextBinary(group))
+			return true;
+
+		group.code_ = DXF_INVALID_CODE;
+		group.value_ = "";
+		group.length_ = 0;
+		group.type_ = DXF_VALUE_TEXT;
+		return false;
+	}
+
+	//read the code
+	const char* code;
+	unsigned codeLength;
+	ReadLine(code, codeLength);
+	group.code_ = ParseCode(code, codeLength);
+
+	//read the value
+	if (!IsEof())
+		ReadLine(group.value_, group.length_);
+
+	lineNumber_ += 2;
+
+	return true;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Container/ArrayPtr.h"
+#include "Container/Ptr.h"
+#include "Container/Str.h"
+#include "IO/MappedFile.h"
+#include "Math/MathDefs.h"
+#include "Math/StringHash.h"
+
+namespace Urho3D
+{
+	class WorkQueue;
+}
+
+using namespace Urho3D;
+
+//code returned when no group could be read. DXF has some negative codes, so 0 or -1 won't do.
+static const int DXF_INVALID_CODE = -100;
+
+//first bytes of a binary dxf file
+static const char DXF_BINARY_SENTINEL[] = "AutoCAD Binary DXF\r\n\x1a";
+//length of the sentinel including its terminating zero
+static const unsigned DXF_BINARY_SENTINEL_LENGTH = sizeof(DXF_BINARY_SENTINEL);
+
+//byte offset into a DXF buffer. 64-bit, point clouds are exported to files well over 4GB.
+typedef unsigned long long DxfOffset;
+static const DxfOffset DXF_NO_OFFSET = 0xffffffffffffffffULL;
+
+//how the value of a group is stored
+enum DxfValueType
+{
+	//text: every value of an ascii file, and the strings of a binary one
+	DXF_VALUE_TEXT = 0,
+	//little-endian binary values of a binary file
+	DXF_VALUE_DOUBLE,
+	DXF_VALUE_INT16,
+	DXF_VALUE_INT32,
+	DXF_VALUE_INT64,
+	DXF_VALUE_BOOL,
+	//a length-prefixed chunk of bytes, eg. code 310. value_ points past the length.
+	DXF_VALUE_BINARY
+};
+
+//SDBM hash of a name, like StringHash but case-sensitive and without a terminator
+inline StringHash DxfHash(const char* value, unsigned length)
+{
+	unsigned hash = 0;
+	for (unsigned i = 0; i < length; ++i)
+		hash = SDBMHash(hash, (unsigned char)value[i]);
+	return StringHash(hash);
+}
+
+/**************************************************************************
+A single group of a dxf file: the group code and its value, eg:
+ ---- 10        <- code
+ ---- 1.25      <- value
+
+The value is a view into the tokenizer's buffer. It is trimmed of blanks,
+it is NOT null terminated, and it stays valid only as long as the
+tokenizer that produced it. Nothing is allocated unless GetString() is called.
+
+Groups of a binary file point at the raw little-endian value instead;
+type_ says how to read it. The conversions work on either kind.
+***************************************************************************/
+struct DxfGroup
+{
+	DxfGroup() :
+		code_(DXF_INVALID_CODE),
+		value_(""),
+		length_(0),
+		type_(DXF_VALUE_TEXT)
+	{
+	}
+
+	//compare code and value without building any strings
+	bool Is(int code, const char* value) const { return code_ == code && Equals(value); }
+	//compare the value only
+	bool Equals(const char* value) const;
+	//case-sensitive hash of the value, the same as DxfHash() of the text
+	StringHash GetHash() const { return DxfHash(value_, length_); }
+
+	//conversions of the value
+	String GetString() const;
+	float GetFloat() const;
+	double GetDouble() const;
+	int GetInt() const;
+	unsigned GetUInt() const;
+
+	//group code
+	int code_;
+	//start of the value text
+	const char* value_;
+	//length of the value text, or of the binary value
+	unsigned length_;
+	//DxfValueType
+	unsigned type_;
+};
+
+/**************************************************************************
+Splits a contiguous dxf buffer into groups. The buffer is either a memory
+mapped file or any block of memory handed in by the caller.
+Lines are found with memchr, so the per-group cost is a couple of short
+scans and no allocations.
+
+Binary files are recognized by their sentinel. Their group codes are
+2 bytes (R13 and later) or 1 byte with 255 escaping a 2 byte code (R12),
+and the type of the value follows from the code. Positions and Seek()
+work the same way for both kinds.
+***************************************************************************/
+class DxfTokenizer
+{
+public:
+	DxfTokenizer();
+
+	//map a file from disk. LZ4 frames (see DxfCompression.h) are expanded, on the WorkQueue if one is given.
+	bool Open(const String& path, WorkQueue* queue = 0);
+	//tokenize an existing buffer. It is not copied, so it must outlive the tokenizer.
+	void SetBuffer(const char* data, DxfOffset size);
+	//tokenize the expansion of an LZ4 frame. The tokenizer keeps the expanded copy.
+	bool SetCompressedBuffer(const char* data, DxfOffset size, WorkQueue* queue = 0);
+
+	//read the next group. Returns false and an invalid group at the end of the buffer.
+	bool Next(DxfGroup& group);
+	//skip to the next group with code 0 and read it; position is where it starts. Text lines are
+	//only searched for their breaks (memchr), codes are not converted and values not looked at.
+	bool NextEntity(DxfGroup& group, DxfOffset& position);
+
+	//position handling, in bytes from the start of the buffer
+	DxfOffset GetPosition() const { return (DxfOffset)(cursor_ - begin_); }
+	void Seek(DxfOffset position);
+
+	bool IsEof() const { return cursor_ >= end_; }
+	bool IsBinary() const { return binary_; }
+	DxfOffset GetSize() const { return (DxfOffset)(end_ - begin_); }
+	const char* GetData() const { return begin_; }
+	unsigned GetLineNumber() const { return lineNumber_; }
+
+	//how a binary file stores the value of a group code
+	static DxfValueType GetBinaryValueType(int code);
+
+private:
+	//read the line at the cursor, trimmed of blanks, and move past its line break
+	void ReadLine(const char*& start, unsigned& length);
+	//read a group of a binary file
+	bool NextBinary(DxfGroup& group);
+
+	//keeps the mapping alive when the tokenizer opened the file itself
+	SharedPtr<MappedFile> file_;
+	//the expanded contents of a compressed file or buffer
+	SharedArrayPtr<char> expanded_;
+
+	const char* begin_;
+	const char* end_;
+	const char* cursor_;
+
+	//'\n', or '\r' for files that use bare carriage returns
+	char lineBreak_;
+	//binary file, and the size of its group codes
+	bool binary_;
+	unsigned codeSize_;
+	unsigned lineNumber_;
+};
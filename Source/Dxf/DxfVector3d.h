@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Math/Vector3.h"
+
+using namespace Urho3D;
+
+//a position in double precision, for survey-scale coordinates that a float can't hold
+struct DxfVector3d
+{
+	DxfVector3d() :
+		x_(0.0),
+		y_(0.0),
+		z_(0.0)
+	{
+	}
+
+	DxfVector3d(double x, double y, double z) :
+		x_(x),
+		y_(y),
+		z_(z)
+	{
+	}
+
+	DxfVector3d operator +(const DxfVector3d& rhs) const { return DxfVector3d(x_ + rhs.x_, y_ + rhs.y_, z_ + rhs.z_); }
+	DxfVector3d operator -(const DxfVector3d& rhs) const { return DxfVector3d(x_ - rhs.x_, y_ - rhs.y_, z_ - rhs.z_); }
+	bool operator ==(const DxfVector3d& rhs) const { return x_ == rhs.x_ && y_ == rhs.y_ && z_ == rhs.z_; }
+	bool operator !=(const DxfVector3d& rhs) const { return !(*this == rhs); }
+
+	//rounded to float
+	Vector3 ToVector3() const { return Vector3((float)x_, (float)y_, (float)z_); }
+
+	double x_;
+	double y_;
+	double z_;
+};
@@ -0,0 +1,362 @@
+#include "DxfWatcher.h"
+#include "DxfCache.h"
+#include "DxfReader.h"
+
+#include "Container/HashMap.h"
+#include "IO/FileSystem.h"
+#include "IO/Log.h"
+
+DxfWatcher::DxfWatcher(Context* context) :
+	Object(context),
+	rest_(0)
+{
+	//the file watcher and the readers look for files through it
+	if (!GetSubsystem<FileSystem>())
+		GetContext()->RegisterSubsystem(new FileSystem(GetContext()));
+}
+
+DxfWatcher::~DxfWatcher()
+{
+	if (fileWatcher_)
+		fileWatcher_->StopWatching();
+}
+
+bool DxfWatcher::Open(const String& path)
+{
+	path_ = path;
+
+	if (!ParseAll())
+		return false;
+
+	String directory = Urho3D::GetPath(path_);
+	fileWatcher_ = new FileWatcher(GetContext());
+	if (!fileWatcher_->StartWatching(directory.Empty() ? "./" : directory, false))
+		URHO3D_LOGWARNING("DXF: can not watch " + path_ + ", changes are only found by Reload()");
+
+	return true;
+}
+
+bool DxfWatcher::Update()
+{
+	if (!fileWatcher_)
+		return false;
+
+	//the watcher reports names relative to the directory
+	String name = GetFileNameAndExtension(path_);
+	String fileName;
+	bool saved = false;
+
+	while (fileWatcher_->GetNextChange(fileName))
+	{
+		if (fileName == name)
+			saved = true;
+	}
+
+	return saved && Reload();
+}
+
+void DxfWatcher::Snapshot(DxfReader& reader, Vector<EntityState>& entities, unsigned long long& rest)
+{
+	const DxfTokenizer& tokenizer = reader.GetTokenizer();
+	const char* data = tokenizer.GetData();
+	DxfOffset size = tokenizer.GetSize();
+
+	//sections are copied out, looking up another one may move them
+	DxfSection header;
+	DxfSection blocks;
+	DxfSection section;
+	if (const DxfSection* found = reader.GetSection("HEADER"))
+		header = *found;
+	if (const DxfSection* found = reader.GetSection("BLOCKS"))
+		blocks = *found;
+	if (const DxfSection* found = reader.GetSection("ENTITIES"))
+		section = *found;
+	const PODVector<DxfOffset>& offsets = reader.GetEntityOffsets();
+	DxfOffset end = Min(section.end_, size);
+
+	DxfTokenizer scanner(tokenizer);
+	DxfGroup group;
+	entities.Resize(offsets.Size());
+
+	for (unsigned i = 0; i < offsets.Size(); ++i)
+	{
+		DxfOffset start = offsets[i];
+		DxfOffset stop = i + 1 < offsets.Size() ? offsets[i + 1] : end;
+		EntityState& entity = entities[i];
+		entity.hash_ = DxfContentHash(data + start, stop - start);
+		entity.handle_.Clear();
+		entity.entity_ = M_MAX_UNSIGNED;
+		entity.insertion_ = M_MAX_UNSIGNED;
+
+		//the handle follows the 0 group, before anything of a POLYLINE's VERTEXes
+		scanner.Seek(start);
+		scanner.Next(group);
+		while (scanner.GetPosition() < stop && scanner.Next(group) && group.code_ != 0)
+		{
+			if (group.code_ == 5)
+			{
+				entity.handle_ = group.GetString();
+				break;
+			}
+		}
+	}
+
+	//the block definitions, whole
+	rest = 0;
+	if (!blocks.name_.Empty())
+		rest = DxfContentHash(data + blocks.start_, Min(blocks.end_, size) - blocks.start_);
+
+	//and of HEADER, the variables DxfReader::ParseHeader() reads
+	if (!header.name_.Empty())
+	{
+		DxfOffset headerEnd = Min(header.end_, size);
+		bool used = false;
+
+		scanner.Seek(header.start_);
+		while (scanner.GetPosition() < headerEnd && scanner.Next(group) && group.code_ != 0)
+		{
+			if (group.code_ == 9)
+				used = group.Equals("$EXTMIN") || group.Equals("$EXTMAX");
+			if (used)
+				rest = DxfContentHash(group.value_, group.length_, DxfContentHash(&group.code_, sizeof group.code_, rest));
+		}
+	}
+}
+
+void DxfWatcher::ParseEntity(DxfReader& reader, unsigned index, EntityState& entity)
+{
+	const DxfDocument* document = reader.GetDocument();
+	unsigned numEntities = document->GetEntities().Size();
+	unsigned numInsertions = document->GetInsertions().Size();
+
+	reader.ParseEntityAt(index);
+
+	entity.entity_ = document->GetEntities().Size() > numEntities ? numEntities : M_MAX_UNSIGNED;
+	entity.insertion_ = document->GetInsertions().Size() > numInsertions ? numInsertions : M_MAX_UNSIGNED;
+}
+
+void DxfWatcher::ParseWhole(DxfReader& reader, Vector<EntityState>& entities)
+{
+	reader.ParseSection("HEADER");
+	reader.ParseSection("BLOCKS");
+
+	for (unsigned i = 0; i < entities.Size(); ++i)
+		ParseEntity(reader, i, entities[i]);
+
+	//the entities are all in, this only adds the block of the drawing, as Parse() does
+	reader.ParseSection("ENTITIES");
+	reader.GetDocument()->ResolveInsertions();
+}
+
+SharedPtr<DxfDocument> DxfWatcher::Patch(const DxfDocument& changed, Vector<EntityState>& entities, const PODVector<unsigned>& sources) const
+{
+	SharedPtr<DxfDocument> patched(new DxfDocument());
+	patched->SetOrigin(document_->GetOrigin());
+	patched->GetHeader() = document_->GetHeader();
+
+	//the same layer ids as before, the block entities keep theirs
+	const Vector<String>& layers = document_->GetLayers();
+	for (unsigned i = 0; i < layers.Size(); ++i)
+		patched->AddLayer(layers[i].CString(), layers[i].Length());
+
+	//BLOCKS did not change, so the definitions and the INSERTs inside them are taken over
+	const Vector<DxfBlock>& blocks = document_->GetBlocks();
+	for (unsigned i = 0; i < blocks.Size(); ++i)
+	{
+		DxfBlock& block = patched->AddBlock();
+		block = blocks[i];
+		if (block.generic_)
+			continue;
+
+		block.entityStart_ = patched->GetEntities().Size();
+		for (unsigned j = 0; j < blocks[i].entityCount_; ++j)
+			patched->CopyEntity(*document_, blocks[i].entityStart_ + j);
+	}
+
+	const Vector<DxfInsertion>& insertions = document_->GetInsertions();
+	for (unsigned i = 0; i < insertions.Size(); ++i)
+	{
+		if (insertions[i].parent_ != DXF_NO_BLOCK)
+			patched->AddInsertion() = insertions[i];
+	}
+
+	//then the drawing, in the order of the new file
+	for (unsigned i = 0; i < entities.Size(); ++i)
+	{
+		EntityState& entity = entities[i];
+		bool kept = sources[i] != M_MAX_UNSIGNED;
+		const DxfDocument& source = kept ? *document_ : changed;
+		unsigned made = kept ? entities_[sources[i]].entity_ : entity.entity_;
+		unsigned madeInsertion = kept ? entities_[sources[i]].insertion_ : entity.insertion_;
+
+		entity.entity_ = made != M_MAX_UNSIGNED ? patched->CopyEntity(source, made) : M_MAX_UNSIGNED;
+		entity.insertion_ = M_MAX_UNSIGNED;
+		if (madeInsertion != M_MAX_UNSIGNED)
+		{
+			entity.insertion_ = patched->GetInsertions().Size();
+			patched->AddInsertion() = source.GetInsertions()[madeInsertion];
+		}
+	}
+
+	patched->ResolveInsertions();
+	return patched;
+}
+
+bool DxfWatcher::ParseAll()
+{
+	changes_.Clear();
+	changed_ = new DxfDocument();
+
+	if (!GetSubsystem<FileSystem>()->FileExists(path_))
+	{
+		URHO3D_LOGERROR("DXF: could not open " + path_);
+		return false;
+	}
+
+	//entity by entity, so each one knows what it made in the document
+	SharedPtr<DxfReader> reader(new DxfReader(GetContext(), path_));
+	Snapshot(*reader, entities_, rest_);
+	ParseWhole(*reader, entities_);
+	document_ = reader->GetDocument();
+
+	return true;
+}
+
+bool DxfWatcher::Reload()
+{
+	changes_.Clear();
+	changed_ = new DxfDocument();
+
+	if (!GetSubsystem<FileSystem>()->FileExists(path_))
+		return false;
+
+	SharedPtr<DxfReader> reader(new DxfReader(GetContext(), path_));
+
+	//the index only looks at group codes, nothing is parsed yet
+	Vector<EntityState> entities;
+	unsigned long long rest;
+	Snapshot(*reader, entities, rest);
+
+	//the file is mapped and indexed already, so the same reader parses it whole
+	if (rest != rest_)
+	{
+		ParseWhole(*reader, entities);
+		document_ = reader->GetDocument();
+		entities_ = entities;
+		rest_ = rest;
+		AddChange(DXF_DOCUMENT_RELOADED, M_MAX_UNSIGNED, String::EMPTY, M_MAX_UNSIGNED, M_MAX_UNSIGNED);
+		SendChanges();
+		return true;
+	}
+
+	//the old entities by handle, and by content for those without one
+	HashMap<String, unsigned> handles;
+	HashMap<unsigned long long, PODVector<unsigned> > contents;
+	for (unsigned i = 0; i < entities_.Size(); ++i)
+	{
+		if (entities_[i].handle_.Empty())
+			contents[entities_[i].hash_].Push(i);
+		else
+			handles[entities_[i].handle_] = i;
+	}
+
+	PODVector<bool> kept(entities_.Size());
+	for (unsigned i = 0; i < kept.Size(); ++i)
+		kept[i] = false;
+
+	//the old entity each new one is the same as
+	PODVector<unsigned> sources(entities.Size());
+	for (unsigned i = 0; i < sources.Size(); ++i)
+		sources[i] = M_MAX_UNSIGNED;
+
+	for (unsigned i = 0; i < entities.Size(); ++i)
+	{
+		EntityState& entity = entities[i];
+		bool modified = false;
+
+		if (!entity.handle_.Empty())
+		{
+			HashMap<String, unsigned>::Iterator old = handles.Find(entity.handle_);
+			if (old != handles.End() && !kept[old->second_])
+			{
+				kept[old->second_] = true;
+				if (entities_[old->second_].hash_ == entity.hash_)
+				{
+					sources[i] = old->second_;
+					continue;
+				}
+				modified = true;
+			}
+		}
+		else
+		{
+			//the first old entity with the same bytes that is not taken yet
+			HashMap<unsigned long long, PODVector<unsigned> >::Iterator old = contents.Find(entity.hash_);
+			if (old != contents.End() && !old->second_.Empty())
+			{
+				kept[old->second_.Front()] = true;
+				sources[i] = old->second_.Front();
+				old->second_.Erase(0);
+				continue;
+			}
+		}
+
+		//parse just this one
+		ParseEntity(*reader, i, entity);
+		AddChange(modified ? DXF_ENTITY_MODIFIED : DXF_ENTITY_ADDED, i, entity.handle_, entity.entity_, M_MAX_UNSIGNED);
+	}
+
+	//removed ones are known by their slot in the document before
+	unsigned numParsed = changes_.Size();
+	for (unsigned i = 0; i < entities_.Size(); ++i)
+	{
+		if (!kept[i])
+			AddChange(DXF_ENTITY_REMOVED, i, entities_[i].handle_, M_MAX_UNSIGNED, entities_[i].entity_);
+	}
+
+	//entities without a handle can also just move
+	bool same = changes_.Empty();
+	for (unsigned i = 0; i < sources.Size() && same; ++i)
+		same = sources[i] == i;
+
+	if (!same)
+	{
+		changed_ = reader->GetDocument();
+		document_ = Patch(*changed_, entities, sources);
+		for (unsigned i = 0; i < numParsed; ++i)
+			changes_[i].slot_ = entities[changes_[i].index_].entity_;
+		entities_ = entities;
+	}
+
+	SendChanges();
+
+	return !changes_.Empty();
+}
+
+void DxfWatcher::AddChange(DxfChangeType type, unsigned index, const String& handle, unsigned entity, unsigned slot)
+{
+	changes_.Resize(changes_.Size() + 1);
+	DxfEntityChange& change = changes_.Back();
+	change.type_ = type;
+	change.index_ = index;
+	change.handle_ = handle;
+	change.entity_ = entity;
+	change.slot_ = slot;
+}
+
+void DxfWatcher::SendChanges()
+{
+	using namespace DxfEntityChanged;
+
+	for (unsigned i = 0; i < changes_.Size(); ++i)
+	{
+		VariantMap& eventData = GetEventDataMap();
+		eventData[P_WATCHER] = this;
+		eventData[P_TYPE] = (int)changes_[i].type_;
+		eventData[P_INDEX] = changes_[i].index_;
+		eventData[P_HANDLE] = changes_[i].handle_;
+		eventData[P_ENTITY] = changes_[i].entity_;
+		eventData[P_SLOT] = changes_[i].slot_;
+		SendEvent(E_DXFENTITYCHANGED, eventData);
+	}
+}
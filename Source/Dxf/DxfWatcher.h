@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Core/Object.h"
+#include "Container/Ptr.h"
+#include "Container/Str.h"
+#include "Container/Vector.h"
+#include "IO/FileWatcher.h"
+#include "DxfDocument.h"
+#include "DxfTokenizer.h"
+
+using namespace Urho3D;
+
+class DxfReader;
+
+//what happened to a top-level entity of ENTITIES between two versions of the file
+enum DxfChangeType
+{
+	DXF_ENTITY_ADDED = 0,
+	DXF_ENTITY_REMOVED,
+	DXF_ENTITY_MODIFIED,
+	//something outside ENTITIES changed (HEADER, TABLES, BLOCKS...), the whole file was parsed again
+	DXF_DOCUMENT_RELOADED
+};
+
+//one change found by DxfWatcher::Reload()
+struct DxfEntityChange
+{
+	DxfChangeType type_;
+	//top-level entity index in the new file; in the old one for a removed entity
+	unsigned index_;
+	//code 5, empty if the entity has none
+	String handle_;
+	//the entity in DxfWatcher::GetChangedDocument(), M_MAX_UNSIGNED for removed and unparsed ones
+	unsigned entity_;
+	//the entity in DxfWatcher::GetDocument(): after the reload, or before it for a removed one.
+	//M_MAX_UNSIGNED if the entity made none, eg. an INSERT
+	unsigned slot_;
+};
+
+//sent by DxfWatcher for every change, in the order of GetChanges()
+URHO3D_EVENT(E_DXFENTITYCHANGED, DxfEntityChanged)
+{
+	URHO3D_PARAM(P_WATCHER, Watcher);          // DxfWatcher pointer
+	URHO3D_PARAM(P_TYPE, Type);                // int, DxfChangeType
+	URHO3D_PARAM(P_INDEX, Index);              // unsigned
+	URHO3D_PARAM(P_HANDLE, Handle);            // String
+	URHO3D_PARAM(P_ENTITY, Entity);            // unsigned
+	URHO3D_PARAM(P_SLOT, Slot);                // unsigned
+}
+
+/**************************************************************************
+Watched-document mode. The watcher parses the file once, then follows it
+with a FileWatcher; each save is compared with the version before, and
+only what changed is parsed again:
+ ---- Open(path)    <- full parse, GetDocument()
+ ---- Update()      <- once a frame: reloads when the file was saved
+ ---- GetChanges()  <- added, removed and modified entities, also sent as E_DXFENTITYCHANGED
+Added and modified entities are parsed into GetChangedDocument(), which
+holds only them and is made anew on every reload. GetDocument() follows
+the file: on each reload it is rebuilt from the entities that were kept,
+copied from the document before, and the ones just parsed, in the order of
+the file, so the slots of later changes refer to it.
+
+The comparison only scans group codes: each top-level entity is the byte
+range from its 0 group to the next one's, and is known by its content
+hash. Entities with a handle (code 5) are matched by handle, so an edited
+one is reported as modified; those without are matched by content, so an
+edit shows up as a removal and an addition. Outside ENTITIES only what the
+reader uses is compared: BLOCKS, and the HEADER variables it reads
+($EXTMIN, $EXTMAX). When those change, the file is parsed whole again
+(DXF_DOCUMENT_RELOADED); the rest of HEADER, which CAD programs rewrite
+on every save, and TABLES, CLASSES and OBJECTS are not looked at.
+***************************************************************************/
+class DxfWatcher : public Object
+{
+	URHO3D_OBJECT(DxfWatcher, Object);
+
+public:
+	DxfWatcher(Context* context);
+	virtual ~DxfWatcher();
+
+	//parse the file and start watching its directory
+	bool Open(const String& path);
+	//reload if the file watcher saw the file change. Returns whether there were changes.
+	bool Update();
+	//compare the file on disk with the last version, whether it changed or not
+	bool Reload();
+
+	const String& GetPath() const { return path_; }
+	FileWatcher* GetFileWatcher() const { return fileWatcher_; }
+	//the whole file as of the last reload
+	DxfDocument* GetDocument() const { return document_; }
+	//the entities parsed by the last reload
+	DxfDocument* GetChangedDocument() const { return changed_; }
+	const Vector<DxfEntityChange>& GetChanges() const { return changes_; }
+
+private:
+	//what is remembered of a top-level entity
+	struct EntityState
+	{
+		unsigned long long hash_;
+		String handle_;
+		//what it made in the document, M_MAX_UNSIGNED for nothing
+		unsigned entity_;
+		unsigned insertion_;
+	};
+
+	//hash the entities of the reader's file, and the rest of what it reads from it
+	static void Snapshot(DxfReader& reader, Vector<EntityState>& entities, unsigned long long& rest);
+	//parse one top-level entity and note what it made in the reader's document
+	static void ParseEntity(DxfReader& reader, unsigned index, EntityState& entity);
+	//parse the whole file entity by entity, after Snapshot()
+	static void ParseWhole(DxfReader& reader, Vector<EntityState>& entities);
+	//the document of the new version: what is not in ENTITIES and the kept entities from the old one,
+	//the others from changed. sources holds the old index of each kept entity, M_MAX_UNSIGNED for the others.
+	SharedPtr<DxfDocument> Patch(const DxfDocument& changed, Vector<EntityState>& entities, const PODVector<unsigned>& sources) const;
+	bool ParseAll();
+	void AddChange(DxfChangeType type, unsigned index, const String& handle, unsigned entity, unsigned slot);
+	void SendChanges();
+
+	String path_;
+	SharedPtr<FileWatcher> fileWatcher_;
+	SharedPtr<DxfDocument> document_;
+	SharedPtr<DxfDocument> changed_;
+	Vector<DxfEntityChange> changes_;
+
+	//the version of the file the changes are against
+	Vector<EntityState> entities_;
+	unsigned long long rest_;
+};
@@ -1,30 +1,27 @@
 #include "DxfWriter.h"
+#include "DxfCompression.h"
 #include "Core/StringUtils.h"
 #include "IO/Log.h"
 
-namespace {
-
-	File* dest_;
-}
-
-DxfWriter::DxfWriter(Context* context) : Object(context)
+DxfWriter::DxfWriter(Context* context) : Object(context),
+	stream_(0)
 {
-
+	//create the log, unless there is one already
+	if (!GetSubsystem<Log>()) {
+		GetContext()->RegisterSubsystem(new Log(GetContext()));
+	}
 }
 
-bool DxfWriter::Save(String path)
+bool DxfWriter::Save(String path, bool compress)
 {
-
-	FileSystem* fs = new FileSystem(GetContext());
-
 	//create the file
 	dest_ = new File(GetContext(), path, FILE_WRITE);
 
 	//double check
 	assert(dest_);
 
-	//create the log
-	GetContext()->RegisterSubsystem(new Log(GetContext()));
+	UniquePtr<DxfCompressor> compressor(compress ? new DxfCompressor(*dest_) : 0);
+	stream_ = compress ? (Serializer*)compressor.Get() : (Serializer*)dest_.Get();
 
 	//oepn
 	WriteHeader();
@@ -35,7 +32,13 @@ bool DxfWriter::Save(String path)
 	//close
 	WriteLinePair(0, "EOF");
 
+	if (compressor) {
+		compressor->Finish();
+	}
+
+	stream_ = 0;
 	dest_->Close();
+	dest_.Reset();
 
 	return false;
 }
@@ -44,7 +47,7 @@ bool DxfWriter::Save(String path)
 bool DxfWriter::WriteLinePair(int code, String value)
 {
 
-	if (!dest_)
+	if (!stream_)
 		return false;
 
 	String codeString = "   "; //always write three digits with spaces for unused.
@@ -66,8 +69,8 @@ bool DxfWriter::WriteLinePair(int code, String value)
 		break;
 	}
 
-	dest_->WriteLine(codeString);
-	dest_->WriteLine(value);
+	stream_->WriteLine(codeString);
+	stream_->WriteLine(value);
 
 	return true;
 }
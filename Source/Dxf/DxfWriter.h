@@ -26,8 +26,8 @@ public:
 	***************************************************************************/
 	bool WriteLinePair(int code, String value);
 
-	//main loop for writing
-	bool Save(String path);
+	//main loop for writing. Compressed files are LZ4 frames (.dxf.lz4) that DxfReader opens as they are.
+	bool Save(String path, bool compress = false);
 
 	//setters
 	void SetMesh(Vector<Vector3> vertices, Vector<int> indices, String layer = "Default");
@@ -40,6 +40,11 @@ public:
 
 protected:
 
+	//the file being written during Save()
+	SharedPtr<File> dest_;
+	//where the lines go: the file, or a compressor in front of it
+	Serializer* stream_;
+
 	//These are the things we want. 
 	VariantVector meshes_;
 	VariantVector polylines_;
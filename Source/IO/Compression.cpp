@@ -57,7 +57,7 @@ unsigned DecompressData(void* dest, const void* src, unsigned destSize)
 
 bool CompressStream(Serializer& dest, Deserializer& src)
 {
-    unsigned srcSize = src.GetSize() - src.GetPosition();
+    unsigned srcSize = (unsigned)(src.GetSize() - src.GetPosition());
     // Prepend the source and dest. data size in the stream so that we know to buffer & uncompress the right amount
     if (!srcSize)
     {
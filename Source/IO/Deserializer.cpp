@@ -37,7 +37,7 @@ Deserializer::Deserializer() :
 {
 }
 
-Deserializer::Deserializer(unsigned size) :
+Deserializer::Deserializer(unsigned long long size) :
     position_(0),
     size_(size)
 {
@@ -36,14 +36,14 @@ public:
     /// Construct with zero size.
     Deserializer();
     /// Construct with defined size.
-    Deserializer(unsigned size);
+    Deserializer(unsigned long long size);
     /// Destruct.
     virtual ~Deserializer();
 
     /// Read bytes from the stream. Return number of bytes actually read.
     virtual unsigned Read(void* dest, unsigned size) = 0;
-    /// Set position from the beginning of the stream.
-    virtual unsigned Seek(unsigned position) = 0;
+    /// Set position from the beginning of the stream. Positions and sizes are 64-bit so that files over 4GB can be addressed.
+    virtual unsigned long long Seek(unsigned long long position) = 0;
     /// Return name of the stream.
     virtual const String& GetName() const;
     /// Return a checksum if applicable.
@@ -52,10 +52,10 @@ public:
     virtual bool IsEof() const { return position_ >= size_; }
 
     /// Return current position.
-    unsigned GetPosition() const { return position_; }
+    unsigned long long GetPosition() const { return position_; }
 
     /// Return size.
-    unsigned GetSize() const { return size_; }
+    unsigned long long GetSize() const { return size_; }
 
     /// Read a 64-bit integer.
     long long ReadInt64();
@@ -140,9 +140,9 @@ public:
 
 protected:
     /// Stream position.
-    unsigned position_;
+    unsigned long long position_;
     /// Stream size.
-    unsigned size_;
+    unsigned long long size_;
 };
 
 }
@@ -65,6 +65,24 @@ static const unsigned READ_BUFFER_SIZE = 32768;
 #endif
 static const unsigned SKIP_BUFFER_SIZE = 1024;
 
+int SeekFile(void* handle, unsigned long long position, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64((FILE*)handle, (__int64)position, origin);
+#else
+    return fseeko((FILE*)handle, (off_t)position, origin);
+#endif
+}
+
+long long TellFile(void* handle)
+{
+#ifdef _WIN32
+    return _ftelli64((FILE*)handle);
+#else
+    return (long long)ftello((FILE*)handle);
+#endif
+}
+
 File::File(Context* context) :
     Object(context),
     mode_(FILE_READ),
@@ -170,7 +188,7 @@ unsigned File::Read(void* dest, unsigned size)
     }
 
     if (size + position_ > size_)
-        size = size_ - position_;
+        size = (unsigned)(size_ - position_);
     if (!size)
         return 0;
 
@@ -192,7 +210,7 @@ unsigned File::Read(void* dest, unsigned size)
         {
             if (readBufferOffset_ >= readBufferSize_)
             {
-                readBufferSize_ = Min(size_ - position_, READ_BUFFER_SIZE);
+                readBufferSize_ = (unsigned)Min(size_ - position_, (unsigned long long)READ_BUFFER_SIZE);
                 readBufferOffset_ = 0;
                 ReadInternal(readBuffer_.Get(), readBufferSize_);
             }
@@ -270,7 +288,7 @@ unsigned File::Read(void* dest, unsigned size)
     return size;
 }
 
-unsigned File::Seek(unsigned position)
+unsigned long long File::Seek(unsigned long long position)
 {
     if (!IsOpen())
     {
@@ -297,7 +315,7 @@ unsigned File::Seek(unsigned position)
         {
             unsigned char skipBuffer[SKIP_BUFFER_SIZE];
             while (position > position_)
-                Read(skipBuffer, Min(position - position_, SKIP_BUFFER_SIZE));
+                Read(skipBuffer, (unsigned)Min(position - position_, (unsigned long long)SKIP_BUFFER_SIZE));
         }
         else
             URHO3D_LOGERROR("Seeking backward in a compressed file is not supported");
@@ -332,14 +350,14 @@ unsigned File::Write(const void* data, unsigned size)
     // Need to reassign the position due to internal buffering when transitioning from reading to writing
     if (writeSyncNeeded_)
     {
-        fseek((FILE*)handle_, position_ + offset_, SEEK_SET);
+        SeekFile((FILE*)handle_, position_ + offset_, SEEK_SET);
         writeSyncNeeded_ = false;
     }
 
     if (fwrite(data, size, 1, (FILE*)handle_) != 1)
     {
         // Return to the position where the write began
-        fseek((FILE*)handle_, position_ + offset_, SEEK_SET);
+        SeekFile((FILE*)handle_, position_ + offset_, SEEK_SET);
         URHO3D_LOGERROR("Error while writing to file " + GetName());
         return 0;
     }
@@ -365,7 +383,7 @@ unsigned File::GetChecksum()
 
     URHO3D_PROFILE(CalculateFileChecksum);
 
-    unsigned oldPos = position_;
+    unsigned long long oldPos = position_;
     checksum_ = 0;
 
     Seek(0);
@@ -501,17 +519,17 @@ bool File::OpenInternal(const String& fileName, FileMode mode, bool fromPackage)
 
     if (!fromPackage)
     {
-        fseek((FILE*)handle_, 0, SEEK_END);
-        long size = ftell((FILE*)handle_);
-        fseek((FILE*)handle_, 0, SEEK_SET);
-        if (size > M_MAX_UNSIGNED)
+        SeekFile((FILE*)handle_, 0, SEEK_END);
+        long long size = TellFile((FILE*)handle_);
+        SeekFile((FILE*)handle_, 0, SEEK_SET);
+        if (size < 0)
         {
-            URHO3D_LOGERRORF("Could not open file %s which is larger than 4GB", fileName.CString());
+            URHO3D_LOGERRORF("Could not get the size of file %s", fileName.CString());
             Close();
             size_ = 0;
             return false;
         }
-        size_ = (unsigned)size;
+        size_ = (unsigned long long)size;
         offset_ = 0;
     }
 
@@ -535,7 +553,7 @@ bool File::ReadInternal(void* dest, unsigned size)
         return fread(dest, size, 1, (FILE*)handle_) == 1;
 }
 
-void File::SeekInternal(unsigned newPosition)
+void File::SeekInternal(unsigned long long newPosition)
 {
 #ifdef __ANDROID__
     if (assetHandle_)
@@ -547,7 +565,7 @@ void File::SeekInternal(unsigned newPosition)
     }
     else
 #endif
-        fseek((FILE*)handle_, newPosition, SEEK_SET);
+        SeekFile((FILE*)handle_, newPosition, SEEK_SET);
 }
 
 }
@@ -75,7 +75,7 @@ public:
     /// Read bytes from the file. Return number of bytes actually read.
     virtual unsigned Read(void* dest, unsigned size);
     /// Set position from the beginning of the file.
-    virtual unsigned Seek(unsigned position);
+    virtual unsigned long long Seek(unsigned long long position);
     /// Write bytes to the file. Return number of bytes actually written.
     virtual unsigned Write(const void* data, unsigned size);
 
@@ -114,7 +114,7 @@ private:
     /// Perform the file read internally using either C standard IO functions or SDL RWops for Android asset files. Return true if successful. This does not handle compressed package file reading.
     bool ReadInternal(void* dest, unsigned size);
     /// Seek in file internally using either C standard IO functions or SDL RWops for Android asset files.
-    void SeekInternal(unsigned newPosition);
+    void SeekInternal(unsigned long long newPosition);
 
     /// File name.
     String fileName_;
@@ -135,7 +135,7 @@ private:
     /// Bytes in the current read buffer.
     unsigned readBufferSize_;
     /// Start position within a package file, 0 for regular files.
-    unsigned offset_;
+    unsigned long long offset_;
     /// Content checksum.
     unsigned checksum_;
     /// Compression flag.
@@ -146,4 +146,9 @@ private:
     bool writeSyncNeeded_;
 };
 
+/// Seek a C stdio FILE with a 64-bit offset; fseek takes a long, which is 32-bit on Windows. Return 0 on success.
+URHO3D_API int SeekFile(void* handle, unsigned long long position, int origin);
+/// Return the position of a C stdio FILE as a 64-bit offset, or -1 on error.
+URHO3D_API long long TellFile(void* handle);
+
 }
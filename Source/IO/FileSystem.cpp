@@ -353,6 +353,28 @@ bool FileSystem::CreateDir(const String& pathName)
     return success;
 }
 
+bool FileSystem::RemoveDir(const String& pathName)
+{
+    if (!CheckAccess(pathName))
+    {
+        URHO3D_LOGERROR("Access denied to " + pathName);
+        return false;
+    }
+
+#ifdef _WIN32
+    bool success = RemoveDirectoryW(GetWideNativePath(RemoveTrailingSlash(pathName)).CString()) == TRUE;
+#else
+    bool success = rmdir(GetNativePath(RemoveTrailingSlash(pathName)).CString()) == 0;
+#endif
+
+    if (success)
+        URHO3D_LOGDEBUG("Removed directory " + pathName);
+    else
+        URHO3D_LOGERROR("Failed to remove directory " + pathName);
+
+    return success;
+}
+
 void FileSystem::SetExecuteConsoleCommands(bool enable)
 {
     if (enable == executeConsoleCommands_)
@@ -484,12 +506,20 @@ bool FileSystem::Copy(const String& srcFileName, const String& destFileName)
     if (!destFile->IsOpen())
         return false;
 
-    unsigned fileSize = srcFile->GetSize();
-    SharedArrayPtr<unsigned char> buffer(new unsigned char[fileSize]);
+    // Copy in blocks, the file may not fit in memory or in a 32-bit size
+    const unsigned blockSize = 1 << 20;
+    unsigned long long fileSize = srcFile->GetSize();
+    SharedArrayPtr<unsigned char> buffer(new unsigned char[(unsigned)Min(fileSize, (unsigned long long)blockSize)]);
 
-    unsigned bytesRead = srcFile->Read(buffer.Get(), fileSize);
-    unsigned bytesWritten = destFile->Write(buffer.Get(), fileSize);
-    return bytesRead == fileSize && bytesWritten == fileSize;
+    for (unsigned long long copied = 0; copied < fileSize;)
+    {
+        unsigned size = (unsigned)Min(fileSize - copied, (unsigned long long)blockSize);
+        if (srcFile->Read(buffer.Get(), size) != size || destFile->Write(buffer.Get(), size) != size)
+            return false;
+        copied += size;
+    }
+
+    return true;
 }
 
 bool FileSystem::Rename(const String& srcFileName, const String& destFileName)
@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../IO/File.h"
+#include "../IO/FileSystem.h"
+#include "../IO/Log.h"
+#include "../IO/MappedFile.h"
+#include "../Math/MathDefs.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+
+#include "../DebugNew.h"
+
+namespace Urho3D
+{
+
+MappedFile::MappedFile() :
+    data_(0),
+    size_(0),
+    mapping_(0),
+    isOpen_(false)
+{
+}
+
+MappedFile::MappedFile(const String& fileName) :
+    data_(0),
+    size_(0),
+    mapping_(0),
+    isOpen_(false)
+{
+    Open(fileName);
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const String& fileName)
+{
+    Close();
+
+    if (fileName.Empty())
+    {
+        URHO3D_LOGERROR("Could not map file with empty name");
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(GetWideNativePath(fileName).CString(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && (unsigned long long)fileSize.QuadPart <= (unsigned long long)(size_t)-1)
+        {
+            HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+            if (mapping)
+            {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view)
+                {
+                    mapping_ = mapping;
+                    data_ = (const unsigned char*)view;
+                    size_ = (unsigned long long)fileSize.QuadPart;
+                }
+                else
+                    CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#elif !defined(__ANDROID__)
+    int fd = open(GetNativePath(fileName).CString(), O_RDONLY);
+    if (fd != -1)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && (unsigned long long)st.st_size <= (unsigned long long)(size_t)-1)
+        {
+            void* view = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+#ifdef MADV_SEQUENTIAL
+                madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+                mapping_ = view;
+                data_ = (const unsigned char*)view;
+                size_ = (unsigned long long)st.st_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    if (!mapping_)
+    {
+        // Mapping not possible (empty file, unsupported platform): read the whole file instead
+        FILE* file = 0;
+#ifdef _WIN32
+        file = _wfopen(GetWideNativePath(fileName).CString(), L"rb");
+#else
+        file = fopen(GetNativePath(fileName).CString(), "rb");
+#endif
+        if (!file)
+        {
+            URHO3D_LOGERROR("Could not open file " + fileName);
+            return false;
+        }
+
+        SeekFile(file, 0, SEEK_END);
+        long long fileSize = TellFile(file);
+        SeekFile(file, 0, SEEK_SET);
+        if (fileSize < 0 || (unsigned long long)fileSize > (unsigned long long)(size_t)-1)
+        {
+            URHO3D_LOGERROR("Could not read file " + fileName + ", it does not fit in memory");
+            fclose(file);
+            return false;
+        }
+        if (fileSize > 0)
+        {
+            buffer_ = new unsigned char[(size_t)fileSize];
+            if (fread(buffer_.Get(), (size_t)fileSize, 1, file) != 1)
+            {
+                URHO3D_LOGERROR("Could not read file " + fileName);
+                fclose(file);
+                buffer_.Reset();
+                return false;
+            }
+            data_ = buffer_.Get();
+            size_ = (unsigned long long)fileSize;
+        }
+        fclose(file);
+    }
+
+    fileName_ = fileName;
+    isOpen_ = true;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mapping_)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle((HANDLE)mapping_);
+#elif !defined(__ANDROID__)
+        munmap(mapping_, (size_t)size_);
+#endif
+        mapping_ = 0;
+    }
+
+    buffer_.Reset();
+    data_ = 0;
+    size_ = 0;
+    isOpen_ = false;
+}
+
+}
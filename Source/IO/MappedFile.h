@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/ArrayPtr.h"
+#include "../Container/RefCounted.h"
+#include "../Container/Str.h"
+
+namespace Urho3D
+{
+
+/// Read-only view of a whole filesystem file. Uses a memory mapping where the platform supports it, otherwise reads the file into memory.
+class URHO3D_API MappedFile : public RefCounted
+{
+public:
+    /// Construct.
+    MappedFile();
+    /// Construct and open a filesystem file.
+    MappedFile(const String& fileName);
+    /// Destruct. Unmap the file if open.
+    virtual ~MappedFile();
+
+    /// Open a filesystem file. Return true if successful.
+    bool Open(const String& fileName);
+    /// Unmap and close the file.
+    void Close();
+
+    /// Return the file contents.
+    const unsigned char* GetData() const { return data_; }
+    /// Return the file size. Mapped files may be larger than 4GB on 64-bit platforms.
+    unsigned long long GetSize() const { return size_; }
+    /// Return the file name.
+    const String& GetName() const { return fileName_; }
+    /// Return whether is open.
+    bool IsOpen() const { return isOpen_; }
+    /// Return whether the contents are memory mapped rather than copied.
+    bool IsMapped() const { return mapping_ != 0; }
+
+private:
+    /// Prevent copy construction.
+    MappedFile(const MappedFile& rhs);
+    /// Prevent assignment.
+    MappedFile& operator =(const MappedFile& rhs);
+
+    /// File name.
+    String fileName_;
+    /// File contents.
+    const unsigned char* data_;
+    /// File size.
+    unsigned long long size_;
+    /// Platform mapping handle, or null if the contents were read into the fallback buffer.
+    void* mapping_;
+    /// Fallback buffer when mapping is not available.
+    SharedArrayPtr<unsigned char> buffer_;
+    /// Open flag, needed to distinguish an open empty file.
+    bool isOpen_;
+};
+
+}
@@ -62,7 +62,7 @@ MemoryBuffer::MemoryBuffer(const PODVector<unsigned char>& data) :
 unsigned MemoryBuffer::Read(void* dest, unsigned size)
 {
     if (size + position_ > size_)
-        size = size_ - position_;
+        size = (unsigned)(size_ - position_);
     if (!size)
         return 0;
 
@@ -90,7 +90,7 @@ unsigned MemoryBuffer::Read(void* dest, unsigned size)
     return size;
 }
 
-unsigned MemoryBuffer::Seek(unsigned position)
+unsigned long long MemoryBuffer::Seek(unsigned long long position)
 {
     if (position > size_)
         position = size_;
@@ -102,7 +102,7 @@ unsigned MemoryBuffer::Seek(unsigned position)
 unsigned MemoryBuffer::Write(const void* data, unsigned size)
 {
     if (size + position_ > size_)
-        size = size_ - position_;
+        size = (unsigned)(size_ - position_);
     if (!size)
         return 0;
 
@@ -44,7 +44,7 @@ public:
     /// Read bytes from the memory area. Return number of bytes actually read.
     virtual unsigned Read(void* dest, unsigned size);
     /// Set position from the beginning of the memory area.
-    virtual unsigned Seek(unsigned position);
+    virtual unsigned long long Seek(unsigned long long position);
     /// Write bytes to the memory area.
     virtual unsigned Write(const void* data, unsigned size);
 
@@ -72,7 +72,7 @@ NamedPipe::~NamedPipe()
     Close();
 }
 
-unsigned NamedPipe::Seek(unsigned position)
+unsigned long long NamedPipe::Seek(unsigned long long position)
 {
     return 0;
 }
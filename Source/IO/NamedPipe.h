@@ -50,7 +50,7 @@ public:
     /// Read bytes from the pipe without blocking if there is less data available. Return number of bytes actually read.
     virtual unsigned Read(void* dest, unsigned size);
     /// Set position. No-op for pipes.
-    virtual unsigned Seek(unsigned position);
+    virtual unsigned long long Seek(unsigned long long position);
     /// Write bytes to the pipe. Return number of bytes actually written.
     virtual unsigned Write(const void* data, unsigned size);
     /// Return whether pipe has no data available.
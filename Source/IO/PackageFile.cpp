@@ -67,8 +67,8 @@ bool PackageFile::Open(const String& fileName, unsigned startOffset)
         // to know how much we must rewind to find the package start
         if (!startOffset)
         {
-            unsigned fileSize = file->GetSize();
-            file->Seek((unsigned)(fileSize - sizeof(unsigned)));
+            unsigned long long fileSize = file->GetSize();
+            file->Seek(fileSize - sizeof(unsigned));
             unsigned newStartOffset = fileSize - file->ReadUInt();
             if (newStartOffset < fileSize)
             {
@@ -87,7 +87,8 @@ bool PackageFile::Open(const String& fileName, unsigned startOffset)
 
     fileName_ = fileName;
     nameHash_ = fileName_;
-    totalSize_ = file->GetSize();
+    // The package format stores 32-bit offsets
+    totalSize_ = (unsigned)file->GetSize();
     compressed_ = id == "ULZ4";
 
     unsigned numFiles = file->ReadUInt();
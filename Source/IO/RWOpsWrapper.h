@@ -68,15 +68,15 @@ private:
         switch (whence)
         {
         case RW_SEEK_SET:
-            des->Seek((unsigned)offset);
+            des->Seek((unsigned long long)offset);
             break;
 
         case RW_SEEK_CUR:
-            des->Seek((unsigned)(des->GetPosition() + offset));
+            des->Seek((unsigned long long)(des->GetPosition() + offset));
             break;
 
         case RW_SEEK_END:
-            des->Seek((unsigned)(des->GetSize() + offset));
+            des->Seek((unsigned long long)(des->GetSize() + offset));
             break;
 
         default:
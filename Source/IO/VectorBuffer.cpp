@@ -49,7 +49,7 @@ VectorBuffer::VectorBuffer(Deserializer& source, unsigned size)
 unsigned VectorBuffer::Read(void* dest, unsigned size)
 {
     if (size + position_ > size_)
-        size = size_ - position_;
+        size = (unsigned)(size_ - position_);
     if (!size)
         return 0;
 
@@ -77,7 +77,7 @@ unsigned VectorBuffer::Read(void* dest, unsigned size)
     return size;
 }
 
-unsigned VectorBuffer::Seek(unsigned position)
+unsigned long long VectorBuffer::Seek(unsigned long long position)
 {
     if (position > size_)
         position = size_;
@@ -94,7 +94,7 @@ unsigned VectorBuffer::Write(const void* data, unsigned size)
     if (size + position_ > size_)
     {
         size_ = size + position_;
-        buffer_.Resize(size_);
+        buffer_.Resize((unsigned)size_);
     }
 
     unsigned char* srcPtr = (unsigned char*)data;
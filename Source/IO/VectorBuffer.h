@@ -44,7 +44,7 @@ public:
     /// Read bytes from the buffer. Return number of bytes actually read.
     virtual unsigned Read(void* dest, unsigned size);
     /// Set position from the beginning of the buffer.
-    virtual unsigned Seek(unsigned position);
+    virtual unsigned long long Seek(unsigned long long position);
     /// Write bytes to the buffer. Return number of bytes actually written.
     virtual unsigned Write(const void* data, unsigned size);
 
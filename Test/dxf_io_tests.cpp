@@ -8,9 +8,21 @@
 #include "Core/Variant.h"
 #include "IO/File.h"
 #include "IO/FileSystem.h"
+#include "Core/Thread.h"
+#include "Core/Timer.h"
+#include "Core/WorkQueue.h"
+#include "Core/StringUtils.h"
+#include "Math/Random.h"
+#include "IO/VectorBuffer.h"
 
 #include "Dxf/DxfReader.h"
 #include "Dxf/DxfWriter.h"
+#include "Dxf/DxfNumber.h"
+#include "Dxf/DxfMeshExporter.h"
+#include "Dxf/DxfCompression.h"
+#include "Dxf/DxfCache.h"
+#include "Dxf/DxfWatcher.h"
+#include "Dxf/DxfBatchReader.h"
 
 using namespace Urho3D;
 
@@ -27,6 +39,8 @@ String box = "../../Test/2D_Box.dxf";
 void SaveVariantVector(File* dest, const VariantVector& vector, String indent);
 void SaveVariantMap(File* dest, const VariantMap& map, String indent);
 void SaveRaw(String path, Variant value);
+bool SameDocument(const DxfDocument* a, const DxfDocument* b);
+void ToBinary(const String& path, VectorBuffer& dest);
 
 
 void SaveVariantVector(File* dest, const VariantVector& vector, String indent)
@@ -130,6 +144,24 @@ void SaveRaw(String path, Variant value)
 
 }
 
+bool SameDocument(const DxfDocument* a, const DxfDocument* b)
+{
+	if (a->GetEntities().Size() != b->GetEntities().Size() ||
+		a->GetVertices() != b->GetVertices() ||
+		a->GetIndices() != b->GetIndices() ||
+		a->GetLayers() != b->GetLayers())
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < a->GetEntities().Size(); i++)
+	{
+		if (memcmp(&a->GetEntities()[i], &b->GetEntities()[i], sizeof(DxfEntity)))
+			return false;
+	}
+
+	return true;
+}
 
 TEST(Basic, CheckTestFiles)
 {
@@ -220,4 +252,1626 @@ TEST(Basic, Write)
 
 	writer->Save("../../Test/DxfWriterTest.dxf");
 
-}
\ No newline at end of file
+}
+TEST(Tokenizer, Groups)
+{
+	//mixed padding and line endings, last line without a break
+	const char* text = "  0\r\nSECTION\r\n  2\nENTITIES \n 10\n\t1.5\n0\nEOF";
+
+	DxfTokenizer tokenizer;
+	tokenizer.SetBuffer(text, (unsigned)strlen(text));
+
+	DxfGroup group;
+	EXPECT_TRUE(tokenizer.Next(group));
+	EXPECT_TRUE(group.Is(0, "SECTION"));
+	EXPECT_TRUE(tokenizer.Next(group));
+	EXPECT_TRUE(group.Is(2, "ENTITIES"));
+	EXPECT_FALSE(group.Is(2, "ENTITIE"));
+	EXPECT_TRUE(tokenizer.Next(group));
+	EXPECT_EQ(group.code_, 10);
+	EXPECT_FLOAT_EQ(group.GetFloat(), 1.5f);
+	EXPECT_TRUE(tokenizer.Next(group));
+	EXPECT_TRUE(group.Is(0, "EOF"));
+	EXPECT_TRUE(tokenizer.IsEof());
+	EXPECT_FALSE(tokenizer.Next(group));
+	EXPECT_EQ(group.code_, DXF_INVALID_CODE);
+}
+
+TEST(Document, TypedMatchesVariantView)
+{
+	DxfReader* reader = new DxfReader(ctx, multiObject);
+	reader->Parse();
+
+	DxfDocument* document = reader->GetDocument();
+	const PODVector<DxfEntity>& entities = document->GetEntities();
+
+	unsigned numMeshes = 0;
+	unsigned numMeshVertices = 0;
+	unsigned numPoints = 0;
+	for (unsigned i = 0; i < entities.Size(); i++)
+	{
+		if (document->IsMesh(entities[i]))
+		{
+			numMeshes++;
+			numMeshVertices += entities[i].vertexCount_;
+		}
+		else if (entities[i].type_ == DXF_POINT)
+			numPoints++;
+	}
+
+	VariantVector meshes = reader->GetMeshes();
+	EXPECT_EQ(meshes.Size(), numMeshes);
+	EXPECT_EQ(reader->GetPoints().Size(), numPoints);
+
+	unsigned numViewVertices = 0;
+	for (unsigned i = 0; i < meshes.Size(); i++)
+		numViewVertices += meshes[i].GetVariantMap()["Vertices"]->GetVariantVector().Size();
+	EXPECT_EQ(numViewVertices, numMeshVertices);
+
+	//all entities of the test file are on one layer
+	EXPECT_EQ(document->GetLayers().Size(), 1);
+	EXPECT_EQ(document->GetLayerName(0), "Default");
+}
+
+TEST(Parallel, MatchesSerial)
+{
+	DxfReader* serial = new DxfReader(ctx, multiObject);
+	serial->Parse();
+
+	//small chunks so the test file is split many times
+	DxfReader* parallel = new DxfReader(ctx, multiObject);
+	parallel->SetParallel(true, 256);
+	parallel->Parse();
+
+	EXPECT_TRUE(SameDocument(serial->GetDocument(), parallel->GetDocument()));
+	EXPECT_EQ(serial->GetBlocks().Size(), parallel->GetBlocks().Size());
+}
+
+//parses (and writes) on its own thread with its own reader and writer
+class ParseThread : public Thread
+{
+public:
+	ParseThread(String path, unsigned index) :
+		path_(path),
+		index_(index)
+	{
+	}
+
+	virtual void ThreadFunction()
+	{
+		SharedPtr<DxfReader> reader(new DxfReader(ctx, path_));
+		reader->Parse();
+		document_ = reader->GetDocument();
+
+		//write the points back out, to a file of our own
+		SharedPtr<DxfWriter> writer(new DxfWriter(ctx));
+		const PODVector<DxfEntity>& entities = document_->GetEntities();
+		for (unsigned i = 0; i < entities.Size(); i++)
+		{
+			if (entities[i].type_ == DXF_POINT)
+				writer->SetPoint(document_->GetVertices()[entities[i].vertexStart_]);
+		}
+		writer->Save("DxfStress_" + String(index_) + ".dxf");
+	}
+
+	String path_;
+	unsigned index_;
+	SharedPtr<DxfDocument> document_;
+};
+
+TEST(Parallel, ConcurrentReaders)
+{
+	String files[] = { multiObject, box, baseTestFile };
+	const unsigned numFiles = 3;
+	const unsigned numThreads = 12;
+
+	//serial reference runs
+	SharedPtr<DxfDocument> reference[numFiles];
+	for (unsigned i = 0; i < numFiles; i++)
+	{
+		SharedPtr<DxfReader> reader(new DxfReader(ctx, files[i]));
+		reader->Parse();
+		reference[i] = reader->GetDocument();
+	}
+
+	PODVector<ParseThread*> running;
+	for (unsigned i = 0; i < numThreads; i++)
+	{
+		running.Push(new ParseThread(files[i % numFiles], i));
+		running.Back()->Run();
+	}
+
+	for (unsigned i = 0; i < numThreads; i++)
+	{
+		running[i]->Stop();
+		EXPECT_TRUE(SameDocument(reference[i % numFiles], running[i]->document_));
+
+		//the written points read back the same
+		String written = "DxfStress_" + String(i) + ".dxf";
+		{
+			SharedPtr<DxfReader> reader(new DxfReader(ctx, written));
+			reader->Parse();
+			EXPECT_EQ(reader->GetPoints().Size(), reference[i % numFiles]->ToVariantPoints().Size());
+		}
+		fs->Delete(written);
+
+		delete running[i];
+	}
+}
+
+//counts what the reader streams, keeps nothing
+class CountingHandler : public DxfEntityHandler
+{
+public:
+	CountingHandler() :
+		numEntities_(0),
+		numVertices_(0),
+		numIndices_(0),
+		open_(false)
+	{
+	}
+
+	virtual void OnPoint(const DxfEntity& entity, const Vector3& position) { numEntities_++; numVertices_++; }
+	virtual void OnPolylineBegin(const DxfEntity& entity) { EXPECT_FALSE(open_); open_ = true; }
+	virtual void OnPolylineVertex(const DxfEntity& entity, const Vector3& position, const int* indices, unsigned numIndices)
+	{
+		EXPECT_TRUE(open_);
+		numVertices_++;
+		numIndices_ += numIndices;
+	}
+	virtual void OnPolylineEnd(const DxfEntity& entity) { EXPECT_TRUE(open_); open_ = false; numEntities_++; }
+	virtual void On3DFace(const DxfEntity& entity, const Vector3* corners) { numEntities_++; numVertices_ += 4; }
+
+	unsigned numEntities_;
+	unsigned numVertices_;
+	unsigned numIndices_;
+	bool open_;
+};
+
+TEST(Streaming, MatchesDocument)
+{
+	SharedPtr<DxfReader> reference(new DxfReader(ctx, multiObject));
+	reference->Parse();
+	DxfDocument* document = reference->GetDocument();
+
+	CountingHandler handler;
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, multiObject));
+	reader->SetEntityHandler(&handler);
+	reader->Parse();
+
+	EXPECT_EQ(handler.numEntities_, document->GetEntities().Size());
+	EXPECT_EQ(handler.numVertices_, document->GetVertices().Size());
+	EXPECT_EQ(handler.numIndices_, document->GetIndices().Size());
+
+	//nothing was retained, but the layer table was
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 0);
+	EXPECT_EQ(reader->GetDocument()->GetLayers(), document->GetLayers());
+
+	//block definitions are kept, so INSERTs still make instances of them
+	const char* text =
+		"0\nSECTION\n2\nBLOCKS\n"
+		"0\nBLOCK\n2\nBOLT\n10\n0\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n1\n20\n0\n30\n0\n"
+		"0\n3DFACE\n8\nA\n10\n0\n20\n0\n30\n0\n11\n1\n21\n0\n31\n0\n12\n1\n22\n1\n32\n0\n13\n0\n23\n1\n33\n0\n"
+		"0\nENDBLK\n0\nENDSEC\n"
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nINSERT\n2\nBOLT\n10\n10\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n5\n20\n5\n30\n5\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> blocksReference(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	blocksReference->Parse();
+	document = blocksReference->GetDocument();
+
+	CountingHandler blocksHandler;
+	SharedPtr<DxfReader> blocksReader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	blocksReader->SetEntityHandler(&blocksHandler);
+	blocksReader->Parse();
+	DxfDocument* kept = blocksReader->GetDocument();
+
+	//only the drawing's point is streamed
+	EXPECT_EQ(blocksHandler.numEntities_, 1);
+	EXPECT_EQ(blocksHandler.numVertices_, 1);
+
+	ASSERT_EQ(kept->GetBlocks().Size(), document->GetBlocks().Size());
+	EXPECT_EQ(kept->GetBlocks()[0].entityStart_, document->GetBlocks()[0].entityStart_);
+	EXPECT_EQ(kept->GetBlocks()[0].entityCount_, 2);
+	EXPECT_EQ(kept->GetEntities().Size(), 2);
+	ASSERT_EQ(kept->GetInstances().Size(), 1);
+	EXPECT_EQ(document->GetInstances().Size(), 1);
+
+	SharedPtr<DxfDocument> flat(new DxfDocument());
+	kept->Flatten(*flat);
+	EXPECT_EQ(flat->GetEntities().Size(), 2);
+	EXPECT_TRUE(flat->GetVertices()[0].Equals(Vector3(11, 0, 0)));
+}
+
+//transcode an ascii file to a binary one with 2 byte group codes
+void ToBinary(const String& path, VectorBuffer& dest)
+{
+	DxfTokenizer tokenizer;
+	tokenizer.Open(path);
+
+	dest.Clear();
+	dest.Write(DXF_BINARY_SENTINEL, DXF_BINARY_SENTINEL_LENGTH);
+
+	DxfGroup group;
+	while (tokenizer.Next(group))
+	{
+		dest.WriteShort((short)group.code_);
+
+		switch (DxfTokenizer::GetBinaryValueType(group.code_))
+		{
+		case DXF_VALUE_DOUBLE:
+			dest.WriteDouble(group.GetDouble());
+			break;
+		case DXF_VALUE_INT16:
+			dest.WriteShort((short)group.GetInt());
+			break;
+		case DXF_VALUE_INT32:
+			dest.WriteInt(group.GetInt());
+			break;
+		case DXF_VALUE_INT64:
+			dest.WriteInt64(group.GetInt());
+			break;
+		case DXF_VALUE_BOOL:
+			dest.WriteBool(group.GetInt() != 0);
+			break;
+		case DXF_VALUE_BINARY:
+			dest.WriteUByte(0);
+			break;
+		default:
+			dest.WriteString(group.GetString());
+			break;
+		}
+	}
+}
+
+TEST(Binary, MatchesAscii)
+{
+	String files[] = { multiObject, box, baseTestFile };
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		VectorBuffer binary;
+		ToBinary(files[i], binary);
+
+		SharedPtr<DxfReader> ascii(new DxfReader(ctx, files[i]));
+		ascii->Parse();
+
+		SharedPtr<DxfReader> reader(new DxfReader(ctx, (const char*)binary.GetData(), binary.GetSize()));
+		reader->Parse();
+
+		EXPECT_TRUE(SameDocument(ascii->GetDocument(), reader->GetDocument()));
+		EXPECT_EQ(ascii->GetBlocks().Size(), reader->GetBlocks().Size());
+	}
+}
+
+//timing only, run with --gtest_also_run_disabled_tests
+TEST(Binary, DISABLED_Throughput)
+{
+	//HiresTimer gets its frequency from the Time subsystem
+	if (!ctx->GetSubsystem<Time>())
+		ctx->RegisterSubsystem(new Time(ctx));
+
+	String files[] = { multiObject, box, baseTestFile };
+	const unsigned numRuns = 20;
+
+	for (unsigned i = 0; i < 3; i++)
+	{
+		File file(ctx, files[i]);
+		PODVector<unsigned char> ascii(file.GetSize());
+		file.Read(&ascii[0], ascii.Size());
+
+		VectorBuffer binary;
+		ToBinary(files[i], binary);
+
+		HiresTimer timer;
+		for (unsigned j = 0; j < numRuns; j++)
+		{
+			SharedPtr<DxfReader> reader(new DxfReader(ctx, (const char*)&ascii[0], ascii.Size()));
+			reader->Parse();
+		}
+		long long asciiTime = timer.GetUSec(true);
+
+		for (unsigned j = 0; j < numRuns; j++)
+		{
+			SharedPtr<DxfReader> reader(new DxfReader(ctx, (const char*)binary.GetData(), binary.GetSize()));
+			reader->Parse();
+		}
+		long long binaryTime = timer.GetUSec(true);
+
+		printf("%s: ascii %u bytes in %lld us, binary %llu bytes in %lld us (%u runs)\n", files[i].CString(),
+			ascii.Size(), asciiTime / numRuns, binary.GetSize(), binaryTime / numRuns, numRuns);
+	}
+}
+
+TEST(Number, MatchesStrtod)
+{
+	const char* cases[] = { "0", "-0", "1", "+2.5", "-1.25", "0.1", "3.14159265358979", ".5", "5.", "1e3", "1.5E-7",
+		"-2.5e+10", "123456789012345678901234", "0.000000000000000000000001", "1e400", "1e-400", "1e", "12abc", "", "-",
+		"inf", "nan", "9007199254740993", "1234.5678901234567" };
+
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		double expected = strtod(cases[i], 0);
+		double parsed = DxfToDouble(cases[i], (unsigned)strlen(cases[i]));
+		if (expected != expected)
+			EXPECT_NE(parsed, parsed) << cases[i];
+		else
+			EXPECT_EQ(parsed, expected) << cases[i];
+	}
+
+	//typical coordinates
+	SetRandomSeed(1);
+	char buffer[64];
+	for (unsigned i = 0; i < 100000; i++)
+	{
+		sprintf(buffer, "%.*f", Rand() % 16, Random(-1e6f, 1e6f));
+		EXPECT_EQ(DxfToDouble(buffer, (unsigned)strlen(buffer)), strtod(buffer, 0)) << buffer;
+	}
+
+	//as floats, the same values ToFloat gives
+	for (unsigned i = 0; i < 10000; i++)
+	{
+		String value(Random(-1e5f, 1e5f));
+		EXPECT_EQ((float)DxfToDouble(value.CString(), value.Length()), ToFloat(value)) << value.CString();
+	}
+
+	EXPECT_EQ(DxfToInt("70", 2), 70);
+	EXPECT_EQ(DxfToInt("-42", 3), -42);
+	EXPECT_EQ(DxfToInt("+7x", 3), 7);
+	EXPECT_EQ(DxfToUInt("4000000000", 10), 4000000000u);
+}
+
+//timing only, run with --gtest_also_run_disabled_tests
+TEST(Number, DISABLED_Benchmark)
+{
+	if (!ctx->GetSubsystem<Time>())
+		ctx->RegisterSubsystem(new Time(ctx));
+
+	//a million coordinates as they appear in a file
+	const unsigned numValues = 1000000;
+	SetRandomSeed(2);
+	Vector<String> values(numValues);
+	for (unsigned i = 0; i < numValues; i++)
+		values[i] = String(Random(-1e5f, 1e5f));
+
+	HiresTimer timer;
+	double sum = 0.0;
+	for (unsigned i = 0; i < numValues; i++)
+		sum += ToFloat(String(values[i].CString(), values[i].Length()));
+	long long toFloatTime = timer.GetUSec(true);
+
+	double dxfSum = 0.0;
+	for (unsigned i = 0; i < numValues; i++)
+		dxfSum += (float)DxfToDouble(values[i].CString(), values[i].Length());
+	long long dxfTime = timer.GetUSec(true);
+
+	EXPECT_EQ(sum, dxfSum);
+	printf("%u values: ToFloat %lld us, DxfToDouble %lld us\n", numValues, toFloatTime, dxfTime);
+}
+
+//custom parser for CIRCLE, keeps the radius
+float circleRadius = 0.0f;
+void ParseCircle(DxfReader& reader)
+{
+	const DxfGroup* group = &reader.GetNextGroup();
+	while (!reader.IsEnd(*group) && group->code_ != 0)
+	{
+		if (group->code_ == 40)
+			circleRadius = group->GetFloat();
+		group = &reader.GetNextGroup();
+	}
+}
+
+TEST(Dispatch, CustomAndUnknownEntities)
+{
+	const char* text =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nPOINT\n8\nA\n10\n1\n20\n2\n30\n3\n"
+		"0\nHATCH\n8\nA\n10\n5\n0\nCIRCLE\n8\nA\n40\n2.5\n"
+		"0\nPOINT\n8\nA\n10\n4\n20\n5\n30\n6\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	//unknown entities are skipped whole
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->Parse();
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 2);
+	EXPECT_EQ(reader->GetDocument()->GetVertices()[1], Vector3(4, 5, 6));
+
+	//a registered parser takes its entity, removing one skips it
+	circleRadius = 0.0f;
+	reader = new DxfReader(ctx, text, (unsigned)strlen(text));
+	reader->RegisterEntityParser("CIRCLE", ParseCircle);
+	reader->RegisterEntityParser("POINT", 0);
+	reader->Parse();
+	EXPECT_FLOAT_EQ(circleRadius, 2.5f);
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 0);
+}
+
+TEST(Diagnostics, WarningsAreCounted)
+{
+	const char* text =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nPOLYLINE\n8\nA\n70\n64\n"
+		"0\nVERTEX\n62\n1\n10\n0\n20\n0\n30\n0\n"
+		"0\nVERTEX\n62\n1\n10\n1\n20\n0\n30\n0\n"
+		"0\nVERTEX\n62\n1\n71\n1\n72\n2\n73\n-2\n74\n1\n71\n2\n"
+		"0\nSEQEND\n0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->SetLogLevel(LOG_WARNING);
+	reader->Parse();
+
+	EXPECT_EQ(reader->GetWarningCount(DXF_WARNING_VERTEX_COLOR), 3);
+	EXPECT_EQ(reader->GetWarningCount(DXF_WARNING_FACE_INDICES), 1);
+	EXPECT_EQ(reader->GetDocument()->GetIndices().Size(), 4);
+
+	//counters start over with every parse
+	reader->Parse();
+	EXPECT_EQ(reader->GetWarningCount(DXF_WARNING_VERTEX_COLOR), 0);
+}
+
+TEST(Lazy, SectionsAndEntities)
+{
+	SharedPtr<DxfReader> reference(new DxfReader(ctx, multiObject));
+	reference->Parse();
+	DxfDocument* document = reference->GetDocument();
+	EXPECT_TRUE(document->GetHeader().fields_ & DXF_HEADER_EXTMAX);
+
+	//the header alone indexes nothing past it
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, multiObject));
+	EXPECT_TRUE(reader->ParseSection("HEADER"));
+	EXPECT_EQ(reader->GetSections().Size(), 1);
+	EXPECT_EQ(reader->GetDocument()->GetHeader().extentsMax_, document->GetHeader().extentsMax_);
+	EXPECT_FALSE(reader->ParseSection("NOSUCHSECTION"));
+
+	//entities one by one, from the back, then the rest of the section
+	unsigned numEntities = reader->GetNumEntities();
+	EXPECT_EQ(numEntities, 5);
+	EXPECT_TRUE(reader->ParseEntityAt(numEntities - 1));
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 1);
+	EXPECT_FALSE(reader->ParseEntityAt(numEntities));
+	EXPECT_TRUE(reader->ParseSection("ENTITIES"));
+	EXPECT_TRUE(reader->ParseSection("ENTITIES"));
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), document->GetEntities().Size());
+	EXPECT_EQ(reader->GetDocument()->GetVertices().Size(), document->GetVertices().Size());
+
+	//whole sections parse the same as Parse()
+	reader = new DxfReader(ctx, multiObject);
+	reader->BuildIndex();
+	EXPECT_EQ(reader->GetNumBlocks(), 3);
+	EXPECT_TRUE(reader->ParseSection("BLOCKS"));
+	EXPECT_TRUE(reader->ParseSection("ENTITIES"));
+	EXPECT_TRUE(SameDocument(document, reader->GetDocument()));
+	EXPECT_EQ(reader->GetBlocks().Size(), reference->GetBlocks().Size());
+}
+
+TEST(Precision, OriginShift)
+{
+	//eastings and northings of a survey, millimetres matter
+	const char* text =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nPOINT\n8\nA\n10\n2563817.123\n20\n1204561.457\n30\n412.5\n"
+		"0\nPOINT\n8\nA\n10\n2563817.124\n20\n1204561.458\n30\n412.5\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	//plain floats can't tell the points apart
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->Parse();
+	const PODVector<Vector3>& vertices = reader->GetDocument()->GetVertices();
+	EXPECT_EQ(vertices[0].x_, vertices[1].x_);
+
+	reader = new DxfReader(ctx, text, (unsigned)strlen(text));
+	reader->SetAutoOrigin(true);
+	reader->SetPreciseCoordinates(true);
+	reader->Parse();
+
+	DxfDocument* document = reader->GetDocument();
+	EXPECT_TRUE(document->GetOrigin() == DxfVector3d(2563817.0, 1204561.0, 412.0));
+	EXPECT_NEAR(document->GetVertices()[0].x_, 0.123f, 1e-5f);
+	EXPECT_NEAR(document->GetVertices()[1].x_ - document->GetVertices()[0].x_, 0.001f, 1e-5f);
+	EXPECT_EQ(document->GetPreciseVertices().Size(), 2);
+	EXPECT_EQ(document->GetWorldVertex(1).x_, 2563817.124);
+	EXPECT_EQ(document->GetWorldVertex(0).y_, 1204561.457);
+
+	//a fixed origin, parallel
+	reader = new DxfReader(ctx, multiObject);
+	reader->SetOrigin(DxfVector3d(100.0, 0.0, 0.0));
+	reader->SetParallel(true, 256);
+	reader->Parse();
+	SharedPtr<DxfReader> reference(new DxfReader(ctx, multiObject));
+	reference->Parse();
+	EXPECT_NEAR(reader->GetDocument()->GetVertices()[0].x_ + 100.0f, reference->GetDocument()->GetVertices()[0].x_, 1e-3f);
+}
+
+TEST(Precision, InsertsKeepVerticesInStep)
+{
+	//an INSERT has a position but no vertex, the point after it must get its own precise one
+	const char* text =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nINSERT\n2\nBOLT\n10\n500\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n2563817.123\n20\n1204561.457\n30\n412.5\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->SetOrigin(DxfVector3d(2563817.0, 1204561.0, 412.0));
+	reader->SetPreciseCoordinates(true);
+	reader->SetRecordBounds(true);
+	reader->Parse();
+
+	DxfDocument* document = reader->GetDocument();
+	ASSERT_EQ(document->GetVertices().Size(), 1);
+	EXPECT_EQ(document->GetPreciseVertices().Size(), 1);
+	EXPECT_EQ(document->GetWorldVertex(0).x_, 2563817.123);
+
+	//and the bounds of the point, after those of the INSERT, are its own
+	ASSERT_EQ(reader->GetEntityBounds().Size(), 2);
+	EXPECT_NEAR(reader->GetEntityBounds()[1].bounds_.min_.x_, 0.123f, 1e-5f);
+}
+
+TEST(Instancing, InsertsShareBlockGeometry)
+{
+	const char* text =
+		"0\nSECTION\n2\nBLOCKS\n"
+		"0\nBLOCK\n2\nBOLT\n10\n1\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n2\n20\n0\n30\n0\n"
+		"0\nENDBLK\n0\nENDSEC\n"
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nINSERT\n2\nBOLT\n10\n10\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nBOLT\n10\n0\n20\n0\n30\n0\n50\n90\n41\n2\n42\n2\n43\n2\n"
+		"0\nINSERT\n2\nNUT\n10\n0\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n5\n20\n5\n30\n5\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->Parse();
+	DxfDocument* document = reader->GetDocument();
+
+	//the block point is stored once, the point after the INSERTs is still read
+	EXPECT_EQ(document->GetEntities().Size(), 2);
+	EXPECT_EQ(document->GetInsertions().Size(), 3);
+	EXPECT_EQ(document->GetBlocks()[0].entityCount_, 1);
+
+	//NUT names no block
+	const PODVector<DxfInstance>& instances = document->GetInstances();
+	EXPECT_EQ(instances.Size(), 2);
+	EXPECT_EQ(instances[0].block_, 0);
+
+	SharedPtr<DxfDocument> flat(new DxfDocument());
+	document->Flatten(*flat);
+	EXPECT_EQ(flat->GetEntities().Size(), 2);
+	EXPECT_TRUE(flat->GetVertices()[0].Equals(Vector3(11, 0, 0)));
+	EXPECT_TRUE(flat->GetVertices()[1].Equals(Vector3(0, 2, 0)));
+	EXPECT_EQ(flat->GetLayers().Size(), 1);
+}
+
+TEST(Instancing, NestedInsertsAndCycles)
+{
+	const char* text =
+		"0\nSECTION\n2\nBLOCKS\n"
+		//C holds a point and B, which holds A twice
+		"0\nBLOCK\n2\nC\n10\n0\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n0\n20\n0\n30\n1\n"
+		"0\nINSERT\n2\nB\n10\n0\n20\n10\n30\n0\n"
+		"0\nENDBLK\n"
+		"0\nBLOCK\n2\nB\n10\n0\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nA\n10\n1\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nA\n10\n2\n20\n0\n30\n0\n41\n3\n"
+		"0\nENDBLK\n"
+		"0\nBLOCK\n2\nA\n10\n0\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n1\n20\n0\n30\n0\n"
+		"0\nENDBLK\n"
+		//D and E insert each other
+		"0\nBLOCK\n2\nD\n10\n0\n20\n0\n30\n0\n"
+		"0\nPOINT\n8\nA\n10\n0\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nE\n10\n0\n20\n0\n30\n0\n"
+		"0\nENDBLK\n"
+		"0\nBLOCK\n2\nE\n10\n0\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nD\n10\n0\n20\n0\n30\n0\n"
+		"0\nENDBLK\n"
+		"0\nENDSEC\n"
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nINSERT\n2\nC\n10\n100\n20\n0\n30\n0\n"
+		"0\nINSERT\n2\nD\n10\n0\n20\n0\n30\n0\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->Parse();
+	DxfDocument* document = reader->GetDocument();
+
+	//all INSERTs are kept, one closes the D/E cycle
+	EXPECT_EQ(document->GetInsertions().Size(), 7);
+	EXPECT_EQ(document->ResolveInsertions(), 1);
+
+	//C: its point and A twice through B; D: its point, E adds nothing once the cycle is cut
+	const PODVector<DxfInstance>& instances = document->GetInstances();
+	EXPECT_EQ(instances.Size(), 4);
+
+	SharedPtr<DxfDocument> flat(new DxfDocument());
+	document->Flatten(*flat);
+	ASSERT_EQ(flat->GetVertices().Size(), 4);
+	EXPECT_TRUE(flat->GetVertices()[0].Equals(Vector3(100, 0, 1)));
+	EXPECT_TRUE(flat->GetVertices()[1].Equals(Vector3(102, 10, 0)));
+	EXPECT_TRUE(flat->GetVertices()[2].Equals(Vector3(105, 10, 0)));
+	EXPECT_TRUE(flat->GetVertices()[3].Equals(Vector3(0, 0, 0)));
+	EXPECT_EQ(instances[3].insertion_, 6);
+}
+
+TEST(Preallocation, FewerReallocations)
+{
+	//a polyface mesh with its count hints, and the same without them
+	String mesh = "0\nPOLYLINE\n8\nA\n70\n64\n71\n1000\n72\n1000\n";
+	String bare = "0\nPOLYLINE\n8\nA\n70\n64\n";
+	String vertices;
+	for (unsigned i = 0; i < 1000; i++)
+		vertices += "0\nVERTEX\n70\n192\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+	for (unsigned i = 0; i < 1000; i++)
+		vertices += "0\nVERTEX\n70\n128\n71\n1\n72\n2\n73\n3\n";
+	vertices += "0\nSEQEND\n";
+
+	String head = "0\nSECTION\n2\nENTITIES\n";
+	String tail = "0\nENDSEC\n0\nEOF\n";
+	String hinted = head + mesh + vertices + tail;
+	String unhinted = head + bare + vertices + tail;
+
+	SharedPtr<DxfReader> plain(new DxfReader(ctx, unhinted.CString(), unhinted.Length()));
+	plain->Parse();
+
+	SharedPtr<DxfReader> hints(new DxfReader(ctx, hinted.CString(), hinted.Length()));
+	hints->Parse();
+
+	SharedPtr<DxfReader> precount(new DxfReader(ctx, unhinted.CString(), unhinted.Length()));
+	precount->SetPrecount(true);
+	precount->Parse();
+
+	unsigned numPlain = plain->GetDocument()->GetNumReallocations();
+	unsigned numHints = hints->GetDocument()->GetNumReallocations();
+	unsigned numPrecount = precount->GetDocument()->GetNumReallocations();
+
+	EXPECT_LT(numHints, numPlain);
+	EXPECT_EQ(numPrecount, 3);
+	EXPECT_EQ(precount->GetDocument()->GetVertices().Size(), 2000);
+	EXPECT_EQ(precount->GetDocument()->GetVertices().Capacity(), 2000);
+	EXPECT_EQ(precount->GetDocument()->GetIndices().Capacity(), 3000);
+}
+
+TEST(MeshExport, TrianglesByLayer)
+{
+	//a quad and a triangle with an invisible edge on layer A, a triangle on layer B, a plain polyline
+	const char* text =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\nPOLYLINE\n8\nA\n70\n64\n71\n4\n72\n2\n"
+		"0\nVERTEX\n70\n192\n10\n0\n20\n0\n30\n0\n"
+		"0\nVERTEX\n70\n192\n10\n1\n20\n0\n30\n0\n"
+		"0\nVERTEX\n70\n192\n10\n1\n20\n1\n30\n0\n"
+		"0\nVERTEX\n70\n192\n10\n0\n20\n1\n30\n0\n"
+		"0\nVERTEX\n70\n128\n71\n1\n72\n2\n73\n3\n74\n4\n"
+		"0\nVERTEX\n70\n128\n71\n1\n72\n-3\n73\n4\n"
+		"0\nSEQEND\n"
+		"0\nPOLYLINE\n8\nB\n70\n64\n"
+		"0\nVERTEX\n70\n192\n10\n5\n20\n0\n30\n0\n"
+		"0\nVERTEX\n70\n192\n10\n6\n20\n0\n30\n0\n"
+		"0\nVERTEX\n70\n192\n10\n6\n20\n1\n30\n0\n"
+		"0\nVERTEX\n70\n128\n71\n3\n72\n2\n73\n1\n"
+		"0\nVERTEX\n70\n128\n71\n1\n72\n2\n73\n9\n"
+		"0\nSEQEND\n"
+		"0\nPOLYLINE\n8\nA\n70\n0\n"
+		"0\nVERTEX\n10\n7\n20\n7\n30\n7\n"
+		"0\nSEQEND\n"
+		"0\nPOLYLINE\n8\nA\n70\n64\n"
+		"0\nVERTEX\n70\n192\n10\n0\n20\n0\n30\n2\n"
+		"0\nVERTEX\n70\n192\n10\n1\n20\n0\n30\n2\n"
+		"0\nVERTEX\n70\n192\n10\n1\n20\n1\n30\n2\n"
+		"0\nVERTEX\n70\n128\n71\n1\n72\n2\n73\n3\n74\n0\n"
+		"0\nSEQEND\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	DxfMeshExporter exporter(DXF_LAYOUT_PLANAR);
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text, (unsigned)strlen(text)));
+	reader->SetEntityHandler(&exporter);
+	reader->Parse();
+	exporter.Finish();
+
+	const Vector<DxfMeshBuffer>& buffers = exporter.GetBuffers();
+	ASSERT_EQ(buffers.Size(), 2);
+	EXPECT_EQ(exporter.GetNumInvalidFaces(), 1);
+
+	//layer A: two meshes, 7 vertices, quad + triangle + triangle
+	const DxfMeshBuffer& a = buffers[0];
+	EXPECT_EQ(a.vertexCount_, 7);
+	EXPECT_EQ(a.indexSize_, 2);
+	ASSERT_EQ(a.indexCount_, 12);
+	const unsigned short* indices = reinterpret_cast<const unsigned short*>(a.indexData_.Buffer());
+	const unsigned short expected[] = { 0, 1, 2, 0, 2, 3, 0, 2, 3, 4, 5, 6 };
+	for (unsigned i = 0; i < 12; ++i)
+		EXPECT_EQ(indices[i], expected[i]);
+
+	//planar: all x, then all y, then all z
+	EXPECT_EQ(a.vertexData_.Size(), 21);
+	EXPECT_EQ(a.vertexData_[1], 1.0f);
+	EXPECT_EQ(a.vertexData_[7 + 2], 1.0f);
+	EXPECT_EQ(a.vertexData_[14 + 6], 2.0f);
+
+	//layer B: the face past the last vertex is dropped
+	const DxfMeshBuffer& b = buffers[1];
+	EXPECT_EQ(b.vertexCount_, 3);
+	EXPECT_EQ(b.indexCount_, 3);
+	EXPECT_EQ(reader->GetDocument()->GetLayers()[b.layer_], "B");
+}
+
+TEST(MeshExport, WeldsSharedCorners)
+{
+	//a 130x130 grid of 3DFACE quads, enough vertices to weld in two work items, each corner written by up to 4 faces, with a little noise
+	const unsigned size = 130;
+	String text = "0\nSECTION\n2\nENTITIES\n0\nLINE\n8\nT\n10\n0\n20\n0\n30\n0\n11\n1\n21\n1\n31\n0\n";
+	for (unsigned y = 0; y < size; ++y)
+	{
+		for (unsigned x = 0; x < size; ++x)
+		{
+			float noise = ((x + y) % 2) ? 0.0001f : 0.0f;
+			text += "0\n3DFACE\n8\nT\n";
+			text += "10\n" + String(x + noise) + "\n20\n" + String(y) + "\n30\n0\n";
+			text += "11\n" + String(x + 1) + "\n21\n" + String(y) + "\n31\n0\n";
+			text += "12\n" + String(x + 1) + "\n22\n" + String(y + 1) + "\n32\n0\n";
+			text += "13\n" + String(x) + "\n23\n" + String(y + 1) + "\n33\n0\n";
+		}
+	}
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text.CString(), text.Length()));
+
+	//the LINE is not a face
+	DxfMeshExporter plain;
+	reader->SetEntityHandler(&plain);
+	reader->Parse();
+	plain.Finish();
+	ASSERT_EQ(plain.GetBuffers().Size(), 1);
+	EXPECT_EQ(plain.GetBuffers()[0].vertexCount_, size * size * 4);
+	EXPECT_EQ(plain.GetWeldRatio(), 1.0f);
+
+	WorkQueue* queue = new WorkQueue(ctx);
+	queue->CreateThreads(3);
+
+	DxfMeshExporter welded;
+	welded.SetWeld(0.001f, queue);
+	reader = new DxfReader(ctx, text.CString(), text.Length());
+	reader->SetEntityHandler(&welded);
+	reader->Parse();
+	welded.Finish();
+	delete queue;
+
+	const DxfMeshBuffer& buffer = welded.GetBuffers()[0];
+	EXPECT_EQ(buffer.vertexCount_, (size + 1) * (size + 1));
+	//few enough for 16-bit indices once welded
+	EXPECT_EQ(buffer.indexSize_, 2);
+	EXPECT_EQ(buffer.indexCount_, size * size * 6);
+	EXPECT_NEAR(welded.GetWeldRatio(), (float)((size + 1) * (size + 1)) / (size * size * 4), 1e-6f);
+
+	//neighbouring faces share their corners now
+	const unsigned short* indices = reinterpret_cast<const unsigned short*>(buffer.indexData_.Buffer());
+	EXPECT_EQ(indices[1], indices[6 + 0]);
+	EXPECT_EQ(indices[2], indices[6 + 5]);
+	EXPECT_EQ(welded.GetNumWeldedFaces(), 0);
+
+	//a quad with two corners closer than the epsilon: its first triangle is a sliver that collapses
+	const char* sliver =
+		"0\nSECTION\n2\nENTITIES\n"
+		"0\n3DFACE\n8\nT\n10\n0\n20\n0\n30\n0\n11\n1\n21\n0\n31\n0\n12\n1\n22\n0.0001\n32\n0\n13\n0\n23\n1\n33\n0\n"
+		"0\nENDSEC\n0\nEOF\n";
+
+	DxfMeshExporter collapsed;
+	collapsed.SetWeld(0.001f);
+	reader = new DxfReader(ctx, sliver, (unsigned)strlen(sliver));
+	reader->SetEntityHandler(&collapsed);
+	reader->Parse();
+	collapsed.Finish();
+
+	const DxfMeshBuffer& kept = collapsed.GetBuffers()[0];
+	EXPECT_EQ(kept.vertexCount_, 3);
+	EXPECT_EQ(kept.indexCount_, 3);
+	EXPECT_EQ(collapsed.GetNumWeldedFaces(), 1);
+
+	const unsigned short* keptIndices = reinterpret_cast<const unsigned short*>(kept.indexData_.Buffer());
+	EXPECT_NE(keptIndices[0], keptIndices[1]);
+	EXPECT_NE(keptIndices[1], keptIndices[2]);
+	EXPECT_NE(keptIndices[0], keptIndices[2]);
+}
+
+//needs room for a sparse 4GB file and reads through all of it, run with --gtest_also_run_disabled_tests
+TEST(LargeFile, DISABLED_ParsesPast4GB)
+{
+	//a sparse file: one comment whose value is a hole of more than 4GB, then a POINT
+	String path = "DxfLarge.dxf";
+	const char* head = "0\nSECTION\n2\nENTITIES\n999\n";
+	const char* tail = "\n0\nPOINT\n8\nFAR\n10\n1\n20\n2\n30\n3\n0\nENDSEC\n0\nEOF\n";
+	unsigned long long tailStart = 0x100000000ULL + 4096;
+
+	{
+		SharedPtr<File> file(new File(ctx, path, FILE_WRITE));
+		ASSERT_TRUE(file->IsOpen());
+		file->Write(head, (unsigned)strlen(head));
+		EXPECT_EQ(file->Seek(tailStart), tailStart);
+		file->Write(tail, (unsigned)strlen(tail));
+		EXPECT_EQ(file->GetSize(), tailStart + strlen(tail));
+	}
+
+	{
+		SharedPtr<File> file(new File(ctx, path, FILE_READ));
+		EXPECT_EQ(file->GetSize(), tailStart + strlen(tail));
+		file->Seek(tailStart + 1);
+		EXPECT_EQ(file->ReadLine(), "0");
+		EXPECT_EQ(file->ReadLine(), "POINT");
+	}
+
+	//the tokenizer, seeked straight to the tail
+	DxfTokenizer tokenizer;
+	ASSERT_TRUE(tokenizer.Open(path));
+	EXPECT_EQ(tokenizer.GetSize(), tailStart + strlen(tail));
+	tokenizer.Seek(tailStart + 1);
+	EXPECT_EQ(tokenizer.GetPosition(), tailStart + 1);
+
+	DxfGroup group;
+	ASSERT_TRUE(tokenizer.Next(group));
+	EXPECT_TRUE(group.Is(0, "POINT"));
+	ASSERT_TRUE(tokenizer.Next(group));
+	EXPECT_TRUE(group.Is(8, "FAR"));
+	ASSERT_TRUE(tokenizer.Next(group));
+	EXPECT_EQ(group.code_, 10);
+	EXPECT_EQ(group.GetDouble(), 1.0);
+	while (tokenizer.Next(group) && !group.Is(0, "EOF"));
+	EXPECT_TRUE(group.Is(0, "EOF"));
+
+	tokenizer = DxfTokenizer();
+
+	//and the reader: the index runs through the hole, the entity is parsed from past 4GB
+	{
+		SharedPtr<DxfReader> reader(new DxfReader(ctx, path));
+		reader->BuildIndex();
+		ASSERT_EQ(reader->GetNumEntities(), 1);
+		EXPECT_EQ(reader->GetEntityOffsets()[0], tailStart + 1);
+		ASSERT_TRUE(reader->ParseEntityAt(0));
+
+		const DxfDocument* document = reader->GetDocument();
+		ASSERT_EQ(document->GetEntities().Size(), 1);
+		EXPECT_EQ(document->GetEntities()[0].type_, DXF_POINT);
+		EXPECT_EQ(document->GetVertices()[0], Vector3(1.0f, 2.0f, 3.0f));
+		EXPECT_EQ(document->GetLayerName(document->GetEntities()[0].layer_), "FAR");
+	}
+
+	fs->Delete(path);
+}
+
+TEST(Compression, ReadsWhatItWrites)
+{
+	SharedPtr<DxfWriter> writer(new DxfWriter(ctx));
+	for (unsigned i = 0; i < 50000; i++)
+		writer->SetPoint(Vector3((float)(i % 100), (float)(i / 100), 0.5f));
+
+	writer->Save("DxfPlain.dxf");
+	writer->Save("DxfPacked.dxf.lz4", true);
+
+	unsigned long long plainSize = 0;
+	unsigned long long packedSize = 0;
+	{
+		SharedPtr<File> plain(new File(ctx, "DxfPlain.dxf"));
+		SharedPtr<File> packed(new File(ctx, "DxfPacked.dxf.lz4"));
+		plainSize = plain->GetSize();
+		packedSize = packed->GetSize();
+	}
+	EXPECT_GT(packedSize, 0u);
+	EXPECT_LT(packedSize * 3, plainSize);
+	EXPECT_TRUE(IsDxfCompressedFile(ctx, "DxfPacked.dxf.lz4"));
+	EXPECT_FALSE(IsDxfCompressedFile(ctx, "DxfPlain.dxf"));
+
+	SharedPtr<DxfReader> plainReader(new DxfReader(ctx, "DxfPlain.dxf"));
+	plainReader->Parse();
+	SharedPtr<DxfReader> packedReader(new DxfReader(ctx, "DxfPacked.dxf.lz4"));
+	packedReader->Parse();
+
+	EXPECT_EQ(packedReader->GetDocument()->GetEntities().Size(), 50000);
+	EXPECT_TRUE(SameDocument(plainReader->GetDocument(), packedReader->GetDocument()));
+
+	//small blocks from memory, so the WorkQueue gets several items
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	for (unsigned i = 0; i < 1000; i++)
+		text += "0\nPOINT\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	VectorBuffer buffer;
+	{
+		DxfCompressor compressor(buffer, 256);
+		compressor.Write(text.CString(), text.Length());
+		EXPECT_TRUE(compressor.Finish());
+	}
+
+	SharedPtr<DxfReader> memoryReader(new DxfReader(ctx, (const char*)buffer.GetData(), buffer.GetSize()));
+	memoryReader->Parse();
+	EXPECT_EQ(memoryReader->GetDocument()->GetEntities().Size(), 1000);
+	EXPECT_TRUE(memoryReader->GetDocument()->GetVertices()[999].Equals(Vector3(999, 0, 0)));
+
+	//a damaged frame reads as empty rather than as garbage
+	SharedArrayPtr<char> expanded;
+	DxfOffset expandedSize = 0;
+	EXPECT_TRUE(DecompressDxf(buffer.GetData(), buffer.GetSize(), expanded, expandedSize));
+	EXPECT_EQ(expandedSize, text.Length());
+	EXPECT_FALSE(DecompressDxf(buffer.GetData(), buffer.GetSize() - 1, expanded, expandedSize));
+
+	//and so does one whose headers ask for more than it can hold, before anything is allocated
+	PODVector<unsigned char> damaged(buffer.GetSize());
+	memcpy(&damaged[0], buffer.GetData(), damaged.Size());
+	unsigned huge = 0xffffffff;
+	memcpy(&damaged[DXF_LZ4_MAGIC_LENGTH], &huge, sizeof huge);
+	EXPECT_FALSE(DecompressDxf(&damaged[0], damaged.Size(), expanded, expandedSize));
+
+	memcpy(&damaged[0], buffer.GetData(), damaged.Size());
+	//the first block's header is its unpacked size, then its packed size
+	unsigned blockPacked;
+	memcpy(&blockPacked, &damaged[DXF_LZ4_MAGIC_LENGTH + 8], sizeof blockPacked);
+	unsigned blockUnpacked = blockPacked * DXF_LZ4_MAX_RATIO + 1;
+	memcpy(&damaged[DXF_LZ4_MAGIC_LENGTH + 4], &blockUnpacked, sizeof blockUnpacked);
+	memcpy(&damaged[DXF_LZ4_MAGIC_LENGTH], &blockUnpacked, sizeof blockUnpacked);
+	ASSERT_LE(blockUnpacked, DXF_LZ4_MAX_BLOCK_SIZE);
+	EXPECT_FALSE(DecompressDxf(&damaged[0], damaged.Size(), expanded, expandedSize));
+
+	fs->Delete("DxfPlain.dxf");
+	fs->Delete("DxfPacked.dxf.lz4");
+}
+
+bool IsPipingLayer(const String& layer, void* userData)
+{
+	++*static_cast<unsigned*>(userData);
+	return layer.StartsWith("PIPING");
+}
+
+TEST(Filter, LayersAreSkipped)
+{
+	String polyline = "0\nPOLYLINE\n8\nPIPING_A\n70\n8\n"
+		"0\nVERTEX\n10\n0\n20\n0\n30\n0\n0\nVERTEX\n10\n1\n20\n0\n30\n0\n0\nSEQEND\n";
+	String face = "0\n3DFACE\n8\nOTHER\n10\n0\n20\n0\n30\n0\n11\n1\n21\n0\n31\n0\n12\n1\n22\n1\n32\n0\n13\n1\n23\n1\n33\n0\n";
+
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	for (unsigned i = 0; i < 100; i++)
+	{
+		text += "0\nPOINT\n8\nSTRUCT\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+		text += polyline + face;
+	}
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	Vector<String> structOnly;
+	structOnly.Push("STRUCT");
+
+	SharedPtr<DxfReader> include(new DxfReader(ctx, text.CString(), text.Length()));
+	include->SetLayerFilter(structOnly);
+	include->Parse();
+	EXPECT_EQ(include->GetDocument()->GetEntities().Size(), 100);
+	EXPECT_EQ(include->GetDocument()->GetVertices().Size(), 100);
+	EXPECT_EQ(include->GetNumFilteredEntities(), 200);
+	//no more than the skipped records
+	EXPECT_GT(include->GetFilteredBytes(), text.Length() / 2);
+	EXPECT_LE(include->GetFilteredBytes(), 100 * (polyline.Length() + face.Length()));
+
+	SharedPtr<DxfReader> exclude(new DxfReader(ctx, text.CString(), text.Length()));
+	exclude->SetLayerFilter(structOnly, false);
+	exclude->Parse();
+	EXPECT_EQ(exclude->GetDocument()->GetEntities().Size(), 200);
+	EXPECT_EQ(exclude->GetDocument()->GetVertices().Size(), 600);
+	EXPECT_EQ(exclude->GetNumFilteredEntities(), 100);
+
+	//the predicate is asked once per layer
+	unsigned calls = 0;
+	SharedPtr<DxfReader> predicate(new DxfReader(ctx, text.CString(), text.Length()));
+	predicate->SetLayerPredicate(IsPipingLayer, &calls);
+	predicate->Parse();
+	EXPECT_EQ(calls, 3);
+	EXPECT_EQ(predicate->GetDocument()->GetEntities().Size(), 100);
+	EXPECT_EQ(predicate->GetDocument()->GetEntities()[0].type_, DXF_POLYLINE);
+
+	//chunks filter the same
+	SharedPtr<DxfReader> parallel(new DxfReader(ctx, text.CString(), text.Length()));
+	parallel->SetLayerFilter(structOnly);
+	parallel->SetParallel(true, 1024);
+	parallel->Parse();
+	EXPECT_TRUE(SameDocument(include->GetDocument(), parallel->GetDocument()));
+	EXPECT_EQ(parallel->GetNumFilteredEntities(), 200);
+	EXPECT_EQ(parallel->GetFilteredBytes(), include->GetFilteredBytes());
+}
+
+TEST(Filter, TypesAreSkipped)
+{
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	for (unsigned i = 0; i < 100; i++)
+	{
+		text += "0\nPOINT\n8\nSTRUCT\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+		text += "0\nPOLYLINE\n8\nPIPING\n70\n8\n";
+		text += "0\nVERTEX\n10\n0\n20\n0\n30\n0\n0\nVERTEX\n10\n1\n20\n0\n30\n0\n0\nSEQEND\n";
+		text += "0\n3DFACE\n8\nOTHER\n10\n0\n20\n0\n30\n0\n11\n1\n21\n0\n31\n0\n12\n1\n22\n1\n32\n0\n13\n1\n23\n1\n33\n0\n";
+	}
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	Vector<String> points;
+	points.Push("POINT");
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text.CString(), text.Length()));
+	reader->SetEntitySelection(points);
+	reader->Parse();
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 100);
+	EXPECT_EQ(reader->GetDocument()->GetVertices().Size(), 100);
+	EXPECT_EQ(reader->GetDocument()->GetEntities()[99].type_, DXF_POINT);
+	EXPECT_EQ(reader->GetNumFilteredEntities(), 200);
+	EXPECT_GT(reader->GetFilteredBytes(), text.Length() / 2);
+
+	//a selected POLYLINE keeps its VERTEXes, unless it is not a polyface mesh
+	Vector<String> polylines;
+	polylines.Push("POLYLINE");
+
+	SharedPtr<DxfReader> polyline(new DxfReader(ctx, text.CString(), text.Length()));
+	polyline->SetEntitySelection(polylines);
+	polyline->Parse();
+	EXPECT_EQ(polyline->GetDocument()->GetEntities().Size(), 100);
+	EXPECT_EQ(polyline->GetDocument()->GetVertices().Size(), 200);
+	EXPECT_EQ(polyline->GetNumFilteredEntities(), 200);
+
+	SharedPtr<DxfReader> polyface(new DxfReader(ctx, text.CString(), text.Length()));
+	polyface->SetEntitySelection(polylines);
+	polyface->SetPolyfaceOnly(true);
+	polyface->Parse();
+	EXPECT_EQ(polyface->GetDocument()->GetEntities().Size(), 0);
+	EXPECT_EQ(polyface->GetNumFilteredEntities(), 300);
+
+	//chunks select the same
+	SharedPtr<DxfReader> parallel(new DxfReader(ctx, text.CString(), text.Length()));
+	parallel->SetEntitySelection(points);
+	parallel->SetParallel(true, 1024);
+	parallel->Parse();
+	EXPECT_TRUE(SameDocument(reader->GetDocument(), parallel->GetDocument()));
+	EXPECT_EQ(parallel->GetNumFilteredEntities(), 200);
+	EXPECT_EQ(parallel->GetFilteredBytes(), reader->GetFilteredBytes());
+}
+
+TEST(Query, BoxCullsEntities)
+{
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	for (unsigned i = 0; i < 100; i++)
+	{
+		text += "0\nPOINT\n8\nSTRUCT\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+		text += "0\nPOLYLINE\n8\nPIPING\n70\n8\n";
+		text += "0\nVERTEX\n10\n" + String(i) + "\n20\n1\n30\n0\n0\nVERTEX\n10\n" + String(i) + ".5\n20\n1\n30\n0\n0\nSEQEND\n";
+		text += "0\n3DFACE\n8\nOTHER\n10\n" + String(i) + "\n20\n2\n30\n0\n11\n" + String(i + 1) + "\n21\n2\n31\n0\n12\n" + String(i + 1) + "\n22\n3\n32\n0\n13\n" + String(i) + "\n23\n3\n33\n0\n";
+	}
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	BoundingBox tile(Vector3(9.5f, -1.0f, -1.0f), Vector3(20.5f, 4.0f, 1.0f));
+
+	//points 10 to 20, polylines and faces 9 to 20
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text.CString(), text.Length()));
+	reader->SetQueryBox(tile);
+	reader->Parse();
+	EXPECT_EQ(reader->GetDocument()->GetEntities().Size(), 35);
+	EXPECT_EQ(reader->GetDocument()->GetVertices().Size(), 11 + 12 * 2 + 12 * 4);
+	EXPECT_EQ(reader->GetNumCulledEntities(), 265);
+	ASSERT_EQ(reader->GetEntityBounds().Size(), 300);
+	EXPECT_EQ(reader->GetEntityBounds()[1].bounds_.max_, Vector3(0.5f, 1.0f, 0.0f));
+
+	//a frustum around the same box
+	Frustum frustum;
+	frustum.Define(tile);
+	SharedPtr<DxfReader> framed(new DxfReader(ctx, text.CString(), text.Length()));
+	framed->SetQueryFrustum(frustum);
+	framed->Parse();
+	EXPECT_TRUE(SameDocument(reader->GetDocument(), framed->GetDocument()));
+
+	SharedPtr<DxfReader> parallel(new DxfReader(ctx, text.CString(), text.Length()));
+	parallel->SetQueryBox(tile);
+	parallel->SetParallel(true, 1024);
+	parallel->Parse();
+	EXPECT_TRUE(SameDocument(reader->GetDocument(), parallel->GetDocument()));
+	EXPECT_EQ(parallel->GetNumCulledEntities(), 265);
+	EXPECT_EQ(parallel->GetEntityBounds().Size(), 300);
+
+	//the next tile comes from the saved index
+	String indexPath = "DxfBoundsIndex.bin";
+	ASSERT_TRUE(reader->SaveBoundsIndex(indexPath));
+
+	SharedPtr<DxfReader> indexed(new DxfReader(ctx, text.CString(), text.Length()));
+	ASSERT_TRUE(indexed->LoadBoundsIndex(indexPath));
+	indexed->SetQueryBox(tile);
+	indexed->Parse();
+	EXPECT_TRUE(SameDocument(reader->GetDocument(), indexed->GetDocument()));
+	EXPECT_EQ(indexed->GetNumCulledEntities(), 265);
+
+	//an index of another file is not used
+	String other = text.Replaced("ENTITIES", "ENTITIES\n999\nmoved");
+	SharedPtr<DxfReader> stale(new DxfReader(ctx, other.CString(), other.Length()));
+	ASSERT_TRUE(stale->LoadBoundsIndex(indexPath));
+	stale->SetQueryBox(tile);
+	stale->Parse();
+	EXPECT_TRUE(SameDocument(reader->GetDocument(), stale->GetDocument()));
+	EXPECT_FALSE(stale->HasBoundsIndex());
+
+	//nor one of an edit that keeps the length: point 50 moves into the tile
+	String edited = text.Replaced("10\n50\n20\n0\n", "10\n15\n20\n0\n");
+	ASSERT_EQ(edited.Length(), text.Length());
+	SharedPtr<DxfReader> moved(new DxfReader(ctx, edited.CString(), edited.Length()));
+	ASSERT_TRUE(moved->LoadBoundsIndex(indexPath));
+	moved->SetQueryBox(tile);
+	moved->Parse();
+	EXPECT_FALSE(moved->HasBoundsIndex());
+	EXPECT_EQ(moved->GetDocument()->GetEntities().Size(), 36);
+
+	fs->Delete(indexPath);
+}
+
+TEST(Cache, LoadsWhatItParsed)
+{
+	String cacheDir = "DxfCache";
+	fs->CreateDir(cacheDir);
+
+	SharedPtr<DxfWriter> writer(new DxfWriter(ctx));
+	for (unsigned i = 0; i < 50000; i++)
+		writer->SetPoint(Vector3((float)(i % 100), (float)(i / 100), 0.5f));
+	writer->Save("DxfCached.dxf");
+
+	SharedPtr<DxfReader> first(new DxfReader(ctx, "DxfCached.dxf"));
+	first->SetCacheDirectory(cacheDir);
+	first->Parse();
+	EXPECT_FALSE(first->IsFromCache());
+
+	SharedPtr<DxfReader> second(new DxfReader(ctx, "DxfCached.dxf"));
+	second->SetCacheDirectory(cacheDir);
+	second->Parse();
+	EXPECT_TRUE(second->IsFromCache());
+	EXPECT_EQ(second->GetDocument()->GetEntities().Size(), 50000);
+	EXPECT_TRUE(SameDocument(first->GetDocument(), second->GetDocument()));
+	EXPECT_EQ(second->GetDocument()->GetBlocks().Size(), first->GetDocument()->GetBlocks().Size());
+
+	//other settings make another document
+	SharedPtr<DxfReader> shifted(new DxfReader(ctx, "DxfCached.dxf"));
+	shifted->SetCacheDirectory(cacheDir);
+	shifted->SetOrigin(DxfVector3d(10.0, 0.0, 0.0));
+	shifted->Parse();
+	EXPECT_FALSE(shifted->IsFromCache());
+
+	//compressed blobs of a buffer, with its blocks and insertions
+	File file(ctx, multiObject);
+	PODVector<char> text(file.GetSize());
+	file.Read(&text[0], text.Size());
+
+	SharedPtr<DxfReader> packed(new DxfReader(ctx, &text[0], text.Size()));
+	packed->SetCacheDirectory(cacheDir, true);
+	packed->Parse();
+	SharedPtr<DxfReader> unpacked(new DxfReader(ctx, &text[0], text.Size()));
+	unpacked->SetCacheDirectory(cacheDir, true);
+	unpacked->Parse();
+	EXPECT_TRUE(unpacked->IsFromCache());
+	EXPECT_TRUE(SameDocument(packed->GetDocument(), unpacked->GetDocument()));
+	EXPECT_EQ(unpacked->GetDocument()->GetInsertions().Size(), packed->GetDocument()->GetInsertions().Size());
+	EXPECT_EQ(unpacked->GetDocument()->GetInstances().Size(), packed->GetDocument()->GetInstances().Size());
+
+	//a changed buffer misses
+	char original = text[text.Size() - 2];
+	text[text.Size() - 2] = ' ';
+	SharedPtr<DxfReader> changed(new DxfReader(ctx, &text[0], text.Size()));
+	changed->SetCacheDirectory(cacheDir, true);
+	changed->Parse();
+	EXPECT_FALSE(changed->IsFromCache());
+
+	//a parser of its own is not served a blob made by the built-in ones
+	SharedPtr<DxfReader> custom(new DxfReader(ctx, "DxfCached.dxf"));
+	custom->SetCacheDirectory(cacheDir);
+	custom->RegisterEntityParser("POINT", 0);
+	custom->Parse();
+	EXPECT_FALSE(custom->IsFromCache());
+	EXPECT_EQ(custom->GetDocument()->GetEntities().Size(), 0);
+
+	first.Reset();
+	second.Reset();
+	shifted.Reset();
+	custom.Reset();
+	Vector<String> blobs;
+	fs->ScanDir(blobs, cacheDir, "*.dxfc", SCAN_FILES, false);
+	EXPECT_GE(blobs.Size(), 2);
+
+	//nothing is left half written
+	Vector<String> temporaries;
+	fs->ScanDir(temporaries, cacheDir, "*.tmp", SCAN_FILES, false);
+	EXPECT_EQ(temporaries.Size(), 0);
+
+	//cut short, as by a crash: the blobs are parsed around
+	for (unsigned i = 0; i < blobs.Size(); i++)
+	{
+		PODVector<unsigned char> blob;
+		{
+			File source(ctx, cacheDir + "/" + blobs[i]);
+			blob.Resize(source.GetSize() / 2);
+			source.Read(&blob[0], blob.Size());
+		}
+		File dest(ctx, cacheDir + "/" + blobs[i], FILE_WRITE);
+		dest.Write(&blob[0], blob.Size());
+	}
+	text[text.Size() - 2] = original;
+	SharedPtr<DxfReader> truncated(new DxfReader(ctx, &text[0], text.Size()));
+	truncated->SetCacheDirectory(cacheDir, true);
+	truncated->Parse();
+	EXPECT_FALSE(truncated->IsFromCache());
+	EXPECT_TRUE(SameDocument(packed->GetDocument(), truncated->GetDocument()));
+	truncated.Reset();
+	SharedPtr<DxfReader> truncatedFile(new DxfReader(ctx, "DxfCached.dxf"));
+	truncatedFile->SetCacheDirectory(cacheDir);
+	truncatedFile->Parse();
+	EXPECT_FALSE(truncatedFile->IsFromCache());
+	truncatedFile.Reset();
+
+	//everything the readers wrote, and the directory with it
+	Vector<String> written;
+	fs->ScanDir(written, cacheDir, "*.*", SCAN_FILES, false);
+	for (unsigned i = 0; i < written.Size(); i++)
+		fs->Delete(cacheDir + "/" + written[i]);
+	EXPECT_TRUE(fs->RemoveDir(cacheDir));
+	fs->Delete("DxfCached.dxf");
+}
+
+//writes a drawing of handled points, and one point without a handle
+void WriteWatched(const String& path, unsigned count, float moved)
+{
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	for (unsigned i = 0; i < count; i++)
+	{
+		float x = i == 1 ? moved : (float)i;
+		text += "0\nPOINT\n5\nA" + String(i) + "\n8\n0\n10\n" + String(x) + "\n20\n0\n30\n0\n";
+	}
+	text += "0\nPOINT\n8\n0\n10\n-1\n20\n0\n30\n0\n";
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	File file(ctx, path, FILE_WRITE);
+	file.Write(text.CString(), text.Length());
+}
+
+//counts the change events of a watcher
+class WatchListener : public Object
+{
+	URHO3D_OBJECT(WatchListener, Object);
+
+public:
+	WatchListener(Context* context) : Object(context), events_(0) {}
+
+	void Listen(DxfWatcher* watcher)
+	{
+		SubscribeToEvent(watcher, E_DXFENTITYCHANGED, URHO3D_HANDLER(WatchListener, HandleChange));
+	}
+
+	void HandleChange(StringHash eventType, VariantMap& eventData) { ++events_; }
+
+	unsigned events_;
+};
+
+TEST(Watcher, ReportsChangedEntities)
+{
+	String path = "DxfWatched.dxf";
+	WriteWatched(path, 10, 1.0f);
+
+	SharedPtr<DxfWatcher> watcher(new DxfWatcher(ctx));
+	ASSERT_TRUE(watcher->Open(path));
+	EXPECT_EQ(watcher->GetDocument()->GetEntities().Size(), 11);
+
+	//nothing changed
+	EXPECT_FALSE(watcher->Reload());
+
+	//A1 moved, A10 added, A9 dropped by writing one less
+	WriteWatched(path, 9, 5.5f);
+	String text;
+	{
+		File file(ctx, path);
+		text = file.ReadString();
+	}
+	text.Replace("0\nPOINT\n8\n0\n10\n-1", "0\nPOINT\n5\nA10\n8\n0\n10\n10\n20\n0\n30\n0\n0\nPOINT\n8\n0\n10\n-1");
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(text.CString(), text.Length());
+	}
+
+	SharedPtr<WatchListener> listener(new WatchListener(ctx));
+	listener->Listen(watcher);
+
+	//the watcher thread may have seen the save too; the change is added by hand so the test does not wait for it
+	watcher->GetFileWatcher()->SetDelay(0.0f);
+	watcher->GetFileWatcher()->AddChange(path);
+	ASSERT_TRUE(watcher->Update());
+
+	const Vector<DxfEntityChange>& changes = watcher->GetChanges();
+	ASSERT_EQ(changes.Size(), 3);
+	EXPECT_EQ(changes[0].type_, DXF_ENTITY_MODIFIED);
+	EXPECT_EQ(changes[0].handle_, "A1");
+	EXPECT_EQ(changes[0].index_, 1);
+	EXPECT_EQ(changes[1].type_, DXF_ENTITY_ADDED);
+	EXPECT_EQ(changes[1].handle_, "A10");
+	EXPECT_EQ(changes[2].type_, DXF_ENTITY_REMOVED);
+	EXPECT_EQ(changes[2].handle_, "A9");
+	EXPECT_EQ(listener->events_, 3);
+
+	//only the two were parsed
+	const DxfDocument* changed = watcher->GetChangedDocument();
+	ASSERT_EQ(changed->GetEntities().Size(), 2);
+	EXPECT_EQ(changed->GetVertices()[changed->GetEntities()[changes[0].entity_].vertexStart_].x_, 5.5f);
+	EXPECT_EQ(changed->GetVertices()[changed->GetEntities()[changes[1].entity_].vertexStart_].x_, 10.0f);
+
+	//and the document follows the file, as a full parse of it would read
+	const DxfDocument* document = watcher->GetDocument();
+	ASSERT_EQ(document->GetEntities().Size(), 11);
+	EXPECT_EQ(document->GetVertices()[document->GetEntities()[changes[0].slot_].vertexStart_].x_, 5.5f);
+	EXPECT_EQ(changes[1].slot_, 9);
+	EXPECT_EQ(changes[2].slot_, 9);
+	SharedPtr<DxfReader> full(new DxfReader(ctx, path));
+	full->Parse();
+	EXPECT_TRUE(SameDocument(full->GetDocument(), document));
+
+	//so a second reload reports slots of that document: A3 goes
+	String shorter = text;
+	shorter.Replace("0\nPOINT\n5\nA3\n8\n0\n10\n3\n20\n0\n30\n0\n", "");
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(shorter.CString(), shorter.Length());
+	}
+	ASSERT_TRUE(watcher->Reload());
+	ASSERT_EQ(watcher->GetChanges().Size(), 1);
+	EXPECT_EQ(watcher->GetChanges()[0].type_, DXF_ENTITY_REMOVED);
+	EXPECT_EQ(watcher->GetChanges()[0].handle_, "A3");
+	EXPECT_EQ(watcher->GetChanges()[0].slot_, 3);
+	EXPECT_EQ(watcher->GetDocument()->GetEntities().Size(), 10);
+	SharedPtr<DxfReader> shorterFull(new DxfReader(ctx, path));
+	shorterFull->Parse();
+	EXPECT_TRUE(SameDocument(shorterFull->GetDocument(), watcher->GetDocument()));
+
+	//and comes back where it was
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(text.CString(), text.Length());
+	}
+	ASSERT_TRUE(watcher->Reload());
+	ASSERT_EQ(watcher->GetChanges().Size(), 1);
+	EXPECT_EQ(watcher->GetChanges()[0].type_, DXF_ENTITY_ADDED);
+	EXPECT_EQ(watcher->GetChanges()[0].slot_, 3);
+	EXPECT_TRUE(SameDocument(full->GetDocument(), watcher->GetDocument()));
+
+	//what a CAD program rewrites on every save is not looked at
+	String header = "0\nSECTION\n2\nHEADER\n9\n$TDUPDATE\n40\n2460000.5\n9\n$HANDSEED\n5\nA0\n0\nENDSEC\n";
+	String saved = "999\nsaved again\n" + header + text;
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(saved.CString(), saved.Length());
+	}
+	EXPECT_FALSE(watcher->Reload());
+
+	header.Replace("2460000.5", "2460001.5");
+	header.Replace("A0", "B0");
+	saved = header + text;
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(saved.CString(), saved.Length());
+	}
+	EXPECT_FALSE(watcher->Reload());
+
+	//a change to what the reader uses parses the whole file again
+	saved = header + text;
+	saved.Replace("9\n$HANDSEED", "9\n$EXTMIN\n10\n-1\n20\n0\n30\n0\n9\n$HANDSEED");
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(saved.CString(), saved.Length());
+	}
+	ASSERT_TRUE(watcher->Reload());
+	ASSERT_EQ(watcher->GetChanges().Size(), 1);
+	EXPECT_EQ(watcher->GetChanges()[0].type_, DXF_DOCUMENT_RELOADED);
+
+	saved = header + "0\nSECTION\n2\nBLOCKS\n0\nBLOCK\n2\nB\n10\n0\n20\n0\n30\n0\n0\nENDBLK\n0\nENDSEC\n" + text;
+	{
+		File file(ctx, path, FILE_WRITE);
+		file.Write(saved.CString(), saved.Length());
+	}
+	ASSERT_TRUE(watcher->Reload());
+	ASSERT_EQ(watcher->GetChanges().Size(), 1);
+	EXPECT_EQ(watcher->GetChanges()[0].type_, DXF_DOCUMENT_RELOADED);
+	EXPECT_EQ(watcher->GetDocument()->GetEntities().Size(), 11);
+
+	listener.Reset();
+	watcher.Reset();
+	fs->Delete(path);
+}
+
+TEST(Handles, FindsEntitiesByHandle)
+{
+	//a polyline owning nothing, points owned by it and a face owned by block record 1F
+	String text = "0\nSECTION\n2\nENTITIES\n";
+	text += "0\nPOLYLINE\n5\n2A\n330\n1F\n8\n0\n70\n8\n";
+	text += "0\nVERTEX\n5\n2B\n10\n0\n20\n0\n30\n0\n0\nSEQEND\n5\n2C\n";
+	for (unsigned i = 0; i < 200; i++)
+		text += "0\nPOINT\n5\n" + ToStringHex(0x100 + i) + "\n330\n2A\n8\n0\n10\n" + String(i) + "\n20\n0\n30\n0\n";
+	text += "0\n3DFACE\n5\nff\n102\n{ACAD_REACTORS\n330\n2A\n102\n}\n330\n1F\n8\n0\n10\n0\n20\n0\n30\n0\n11\n1\n21\n0\n31\n0\n12\n1\n22\n1\n32\n0\n";
+	text += "0\nENDSEC\n0\nEOF\n";
+
+	SharedPtr<DxfReader> reader(new DxfReader(ctx, text.CString(), text.Length()));
+	reader->SetHandleIndex(true);
+	reader->Parse();
+
+	const DxfHandleIndex& handles = reader->GetHandleIndex();
+	EXPECT_EQ(handles.GetNumRecords(), 202);
+
+	const DxfHandleRecord* point = handles.Find("00000164");
+	ASSERT_TRUE(point);
+	EXPECT_EQ(point->slot_, 101);
+	EXPECT_EQ(reader->GetDocument()->GetVertices()[reader->GetDocument()->GetEntities()[point->slot_].vertexStart_].x_, 100.0f);
+
+	//the last 330 is the owner, after the reactors
+	const DxfHandleRecord* face = handles.Find("FF");
+	ASSERT_TRUE(face);
+	EXPECT_EQ(face->owner_, 0x1f);
+	EXPECT_EQ(reader->GetDocument()->GetEntities()[face->slot_].type_, DXF_3DFACE);
+
+	const DxfHandleRecord* owner = handles.GetOwner(*point);
+	ASSERT_TRUE(owner);
+	EXPECT_EQ(owner->slot_, 0);
+	EXPECT_FALSE(handles.GetOwner(*owner));
+
+	const unsigned* children;
+	ASSERT_EQ(handles.GetChildren(owner->handle_, children), 200);
+	EXPECT_EQ(handles.GetRecords()[children[0]].handle_, 0x100);
+	EXPECT_EQ(handles.GetChildren(0x1f, children), 2);
+	EXPECT_EQ(handles.GetChildren(0x2b, children), 0);
+	EXPECT_FALSE(handles.Find("2B"));
+	EXPECT_FALSE(handles.Find("not a handle"));
+
+	//chunks number their entities from the start of the document
+	SharedPtr<DxfReader> parallel(new DxfReader(ctx, text.CString(), text.Length()));
+	parallel->SetHandleIndex(true);
+	parallel->SetParallel(true, 1024);
+	parallel->Parse();
+	ASSERT_EQ(parallel->GetHandleIndex().GetNumRecords(), 202);
+	for (unsigned i = 0; i < handles.GetNumRecords(); i++)
+	{
+		const DxfHandleRecord& record = handles.GetRecords()[i];
+		const DxfHandleRecord* other = parallel->GetHandleIndex().Find(record.handle_);
+		ASSERT_TRUE(other);
+		EXPECT_EQ(other->slot_, record.slot_);
+		EXPECT_EQ(other->offset_, record.offset_);
+	}
+
+	//lazy: one entity by its handle, without parsing the rest
+	SharedPtr<DxfReader> lazy(new DxfReader(ctx, text.CString(), text.Length()));
+	lazy->SetHandleIndex(true);
+	EXPECT_TRUE(lazy->ParseEntityByHandle("164"));
+	EXPECT_EQ(lazy->GetDocument()->GetEntities().Size(), 1);
+	EXPECT_EQ(lazy->GetHandleIndex().Find("164")->slot_, 0);
+	EXPECT_EQ(lazy->GetHandleIndex().Find("165")->slot_, DXF_NO_SLOT);
+	EXPECT_FALSE(lazy->ParseEntityByHandle("2B"));
+}
+
+//what a batch delivered
+struct BatchTally
+{
+	unsigned files_;
+	unsigned failed_;
+	unsigned entities_;
+};
+
+void CountBatchResult(const DxfBatchResult& result, void* userData)
+{
+	BatchTally* tally = static_cast<BatchTally*>(userData);
+	++tally->files_;
+	if (result.document_)
+		tally->entities_ += result.document_->GetEntities().Size();
+	else
+		++tally->failed_;
+}
+
+//numFiles files of numPoints points each
+void WriteBatchFiles(const String& directory, unsigned numFiles, unsigned numPoints)
+{
+	fs->CreateDir(directory);
+
+	for (unsigned i = 0; i < numFiles; i++)
+	{
+		SharedPtr<DxfWriter> writer(new DxfWriter(ctx));
+		for (unsigned j = 0; j < numPoints; j++)
+			writer->SetPoint(Vector3((float)i, (float)j, 0.0f));
+		writer->Save(directory + "/batch_" + String(i) + ".dxf");
+	}
+}
+
+TEST(Batch, ReadsEveryFile)
+{
+	const unsigned numFiles = 64;
+	const unsigned numPoints = 2000;
+	String directory = "DxfBatch";
+	WriteBatchFiles(directory, numFiles, numPoints);
+
+	SharedPtr<DxfBatchReader> batch(new DxfBatchReader(ctx));
+	batch->AddDirectory(directory);
+	ASSERT_EQ(batch->GetFiles().Size(), numFiles);
+	batch->AddFile(directory + "/missing.dxf");
+
+	BatchTally tally = { 0, 0, 0 };
+	batch->SetCallback(CountBatchResult, &tally);
+
+	//room for a few files at a time
+	File first(ctx, batch->GetFiles()[0]);
+	DxfOffset fileSize = first.GetSize();
+	first.Close();
+	batch->SetMaxInFlightBytes(fileSize * 4);
+
+	EXPECT_EQ(batch->Run(), numFiles);
+
+	EXPECT_EQ(tally.files_, numFiles + 1);
+	EXPECT_EQ(tally.failed_, 1);
+	EXPECT_EQ(batch->GetNumFailed(), 1);
+	EXPECT_EQ(tally.entities_, numFiles * numPoints);
+	EXPECT_LE(batch->GetPeakInFlightBytes(), fileSize * 4);
+
+	//a compressed copy of the first file counts with what it expands to
+	String packedPath = directory + "/batch_packed.dxf.lz4";
+	DxfOffset packedSize;
+	{
+		File source(ctx, batch->GetFiles()[0]);
+		PODVector<char> text(source.GetSize());
+		source.Read(&text[0], text.Size());
+
+		File dest(ctx, packedPath, FILE_WRITE);
+		DxfCompressor compressor(dest);
+		compressor.Write(&text[0], text.Size());
+		EXPECT_TRUE(compressor.Finish());
+		packedSize = dest.GetSize();
+	}
+
+	SharedPtr<DxfBatchReader> packed(new DxfBatchReader(ctx));
+	packed->AddFile(packedPath);
+	packed->AddFile(batch->GetFiles()[0]);
+	//one file at a time
+	packed->SetMaxInFlightBytes(1);
+	BatchTally packedTally = { 0, 0, 0 };
+	packed->SetCallback(CountBatchResult, &packedTally);
+	EXPECT_EQ(packed->Run(), 2);
+	EXPECT_EQ(packedTally.entities_, 2 * numPoints);
+	EXPECT_EQ(packed->GetPeakInFlightBytes(), packedSize + fileSize);
+	EXPECT_EQ(packed->GetBytesRead(), packedSize + fileSize);
+
+	for (unsigned i = 0; i < numFiles; i++)
+		fs->Delete(batch->GetFiles()[i]);
+	fs->Delete(packedPath);
+	EXPECT_TRUE(fs->RemoveDir(directory));
+}
+
+//timing only, run with --gtest_also_run_disabled_tests
+TEST(Batch, DISABLED_Throughput)
+{
+	if (!ctx->GetSubsystem<Time>())
+		ctx->RegisterSubsystem(new Time(ctx));
+
+	const unsigned numFiles = 64;
+	const unsigned numPoints = 2000;
+	String directory = "DxfBatch";
+	WriteBatchFiles(directory, numFiles, numPoints);
+
+	SharedPtr<DxfBatchReader> batch(new DxfBatchReader(ctx));
+	batch->AddDirectory(directory);
+
+	HiresTimer timer;
+	batch->Run();
+	long long batchTime = timer.GetUSec(false);
+
+	//the same files one after the other
+	timer.Reset();
+	for (unsigned i = 0; i < numFiles; i++)
+	{
+		SharedPtr<DxfReader> reader(new DxfReader(ctx, batch->GetFiles()[i]));
+		reader->Parse();
+	}
+	long long serialTime = timer.GetUSec(false);
+
+	double megabytes = batch->GetBytesRead() / (1024.0 * 1024.0);
+	printf("batch: %u files, %.1f MB in %lld us (%.0f files/s, %.1f MB/s); serial %lld us (%.1f MB/s)\n",
+		numFiles, megabytes, batchTime, numFiles * 1e6 / batchTime, megabytes * 1e6 / batchTime,
+		serialTime, megabytes * 1e6 / serialTime);
+
+	for (unsigned i = 0; i < numFiles; i++)
+		fs->Delete(batch->GetFiles()[i]);
+	fs->RemoveDir(directory);
+}